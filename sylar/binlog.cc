@@ -0,0 +1,646 @@
+#include "binlog.h"
+#include "config.h"
+#include<time.h>
+#include<ctype.h>
+#include<stdio.h>
+#include<string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include<x86intrin.h>
+#endif
+
+namespace sylar {
+
+	//格式串注册表，注册后的格式串不会释放，进程退出时也不析构，避免其他线程退出时还在使用
+	struct FormatRegistry {
+		RWMutex mutex;
+		std::vector<BinaryLog::Format*> formats;
+		std::atomic<size_t> count = {0};
+	};
+
+	static FormatRegistry& GetRegistry() {
+		static FormatRegistry* s_registry = new FormatRegistry;
+		return *s_registry;
+	}
+
+	static uint64_t GetClockNS(clockid_t id) {
+		struct timespec ts;
+		clock_gettime(id, &ts);
+		return ts.tv_sec * 1000000000ul + ts.tv_nsec;
+	}
+
+	static char* EncodeVarint(char* p, uint64_t v) {
+		for(; v >= 0x80; v >>= 7) {
+			*p++ = (char)(v | 0x80);
+		}
+		*p++ = (char)v;
+		return p;
+	}
+
+	static void PutFixed64(std::string& out, uint64_t v) {
+		out.append((const char*)&v, sizeof(v));
+	}
+
+	static void PutString(std::string& out, const char* v, size_t len) {
+		BinaryLog::PutVarint(out, len);
+		out.append(v, len);
+	}
+
+	static void PutString(std::string& out, const std::string& v) {
+		PutString(out, v.c_str(), v.size());
+	}
+
+	//在out末尾加上记录头和内容
+	static void PutRecord(std::string& out, uint8_t type, const std::string& payload) {
+		out.push_back((char)type);
+		BinaryLog::PutVarint(out, payload.size());
+		out.append(payload);
+	}
+
+	static bool GetVarint(const char*& p, const char* end, uint64_t& v) {
+		v = 0;
+		for(int shift = 0; shift < 64 && p < end; shift += 7) {
+			uint8_t c = *p++;
+			v |= (uint64_t)(c & 0x7f) << shift;
+			if(!(c & 0x80)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	static bool GetFixed64(const char*& p, const char* end, uint64_t& v) {
+		if(end - p < (ptrdiff_t)sizeof(v)) {
+			return false;
+		}
+		memcpy(&v, p, sizeof(v));
+		p += sizeof(v);
+		return true;
+	}
+
+	static bool GetString(const char*& p, const char* end, const char*& str, size_t& len) {
+		uint64_t v = 0;
+		if(!GetVarint(p, end, v) || v > (uint64_t)(end - p)) {
+			return false;
+		}
+		str = p;
+		len = v;
+		p += v;
+		return true;
+	}
+
+	static bool GetString(const char*& p, const char* end, std::string& str) {
+		const char* s = nullptr;
+		size_t len = 0;
+		if(!GetString(p, end, s, len)) {
+			return false;
+		}
+		str.assign(s, len);
+		return true;
+	}
+
+	static bool GetLevel(const char*& p, const char* end, LogLevel::Level& level) {
+		if(p >= end) {
+			return false;
+		}
+		level = (LogLevel::Level)(uint8_t)*p++;
+		return true;
+	}
+
+	uint32_t BinaryLog::RegisterFormat(LogLevel::Level level, const char* file, int32_t line
+			, const char* fmt, const std::string& types) {
+		FormatRegistry& r = GetRegistry();
+		Format* f = new Format;
+		f->level = level;
+		f->line = line;
+		f->file = file ? file : "";
+		f->fmt = fmt ? fmt : "";
+		f->types = types;
+		RWMutex::WriteLock lock(r.mutex);
+		r.formats.push_back(f);
+		f->id = r.formats.size();
+		r.count.store(r.formats.size(), std::memory_order_release);
+		return f->id;
+	}
+
+	size_t BinaryLog::GetFormatCount() {
+		return GetRegistry().count.load(std::memory_order_acquire);
+	}
+
+	const BinaryLog::Format* BinaryLog::GetFormat(uint32_t id) {
+		FormatRegistry& r = GetRegistry();
+		RWMutex::ReadLock lock(r.mutex);
+		if(id == 0 || id > r.formats.size()) {
+			return nullptr;
+		}
+		return r.formats[id - 1];
+	}
+
+	uint64_t BinaryLog::Now() {
+#if defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+#else
+		return GetClockNS(CLOCK_MONOTONIC);
+#endif
+	}
+
+	//用单调时钟校准10ms内的计数，要求CPU支持恒定频率的TSC，误差由之后的同步点修正
+	static uint64_t CalibrateTicks() {
+#if defined(__x86_64__) || defined(__i386__)
+		uint64_t ns0 = GetClockNS(CLOCK_MONOTONIC);
+		uint64_t t0 = BinaryLog::Now();
+		uint64_t ns1 = ns0;
+		while(ns1 - ns0 < 10000000) {
+			ns1 = GetClockNS(CLOCK_MONOTONIC);
+		}
+		uint64_t t1 = BinaryLog::Now();
+		return (uint64_t)((double)(t1 - t0) * 1e9 / (ns1 - ns0));
+#else
+		return 1000000000;
+#endif
+	}
+
+	uint64_t BinaryLog::GetTicksPerSecond() {
+		static uint64_t s_ticks = CalibrateTicks();
+		return s_ticks;
+	}
+
+	void BinaryLog::GetSyncPoint(uint64_t& ticks, uint64_t& ns) {
+		uint64_t t0 = Now();
+		ns = GetClockNS(CLOCK_REALTIME);
+		uint64_t t1 = Now();
+		ticks = t0 + (t1 - t0) / 2;
+	}
+
+	void BinaryLog::EncodeHeader(std::string& out) {
+		std::string payload;
+		uint32_t magic = MAGIC;
+		payload.append((const char*)&magic, sizeof(magic));
+		payload.push_back((char)VERSION);
+		PutFixed64(payload, GetTicksPerSecond());
+		uint64_t ticks = 0;
+		uint64_t ns = 0;
+		GetSyncPoint(ticks, ns);
+		PutFixed64(payload, ticks);
+		PutFixed64(payload, ns);
+		PutRecord(out, HEADER, payload);
+	}
+
+	void BinaryLog::EncodeFormat(std::string& out, const Format& format) {
+		std::string payload;
+		PutVarint(payload, format.id);
+		payload.push_back((char)format.level);
+		PutVarint(payload, format.line);
+		PutString(payload, format.file);
+		PutString(payload, format.fmt);
+		PutString(payload, format.types);
+		PutRecord(out, FORMAT, payload);
+	}
+
+	void BinaryLog::EncodeSync(std::string& out) {
+		std::string payload;
+		uint64_t ticks = 0;
+		uint64_t ns = 0;
+		GetSyncPoint(ticks, ns);
+		PutFixed64(payload, ticks);
+		PutFixed64(payload, ns);
+		PutRecord(out, SYNC, payload);
+	}
+
+	void BinaryLog::EncodeText(std::string& out, LogLevel::Level level, const LogEvent::ptr& event) {
+		static thread_local std::string t_payload;
+		t_payload.clear();
+		t_payload.push_back((char)level);
+		PutVarint(t_payload, event->getThreadId());
+		PutVarint(t_payload, event->getFiberId());
+		PutFixed64(t_payload, Now());
+		PutVarint(t_payload, event->getLine());
+		const char* file = event->getFile() ? event->getFile() : "";
+		PutString(t_payload, file, strlen(file));
+		if(event->getLogger()) {
+			PutString(t_payload, event->getLogger()->getName());
+		}
+		else {
+			PutString(t_payload, "", 0);
+		}
+		PutString(t_payload, event->getThreadName());
+		t_payload.append(event->getStream().data(), event->getStream().size());
+		PutRecord(out, TEXT, t_payload);
+	}
+
+	BinaryLog::Encoder& BinaryLog::Encoder::GetThis() {
+		static thread_local Encoder t_encoder;
+		return t_encoder;
+	}
+
+	void BinaryLog::Encoder::finishEvent(uint32_t id, LogLevel::Level level, uint64_t ticks, const std::string& logger) {
+		//记录头先写到栈上得到内容长度，m_record的容量会被复用，不需要分配
+		char head[48];
+		char* p = head;
+		p = EncodeVarint(p, id);
+		*p++ = (char)level;
+		p = EncodeVarint(p, GetThreadId());
+		p = EncodeVarint(p, GetFiberId());
+		memcpy(p, &ticks, sizeof(ticks));
+		p += sizeof(ticks);
+		p = EncodeVarint(p, logger.size());
+		size_t n = p - head;
+		m_record.clear();
+		m_record.push_back((char)EVENT);
+		PutVarint(m_record, n + logger.size() + m_args.size());
+		m_record.append(head, n);
+		m_record.append(logger);
+		m_record.append(m_args);
+	}
+
+	int64_t BinaryLog::ReadRecord(const char* data, size_t len, uint8_t& type, const char*& payload, size_t& payload_len) {
+		if(len == 0) {
+			return 0;
+		}
+		type = (uint8_t)data[0];
+		if(type == 0) {
+			return -1;
+		}
+		const char* p = data + 1;
+		const char* end = data + len;
+		uint64_t v = 0;
+		if(!GetVarint(p, end, v)) {
+			//长度本身不完整，最多10个字节
+			return len < 11 ? 0 : -1;
+		}
+		if(v > (uint64_t)(end - p)) {
+			return 0;
+		}
+		payload = p;
+		payload_len = v;
+		return p + v - data;
+	}
+
+	bool BinaryLog::ParseFormat(const char* data, size_t len, Format& format) {
+		const char* p = data;
+		const char* end = data + len;
+		uint64_t id = 0;
+		uint64_t line = 0;
+		return GetVarint(p, end, id)
+			&& GetLevel(p, end, format.level)
+			&& GetVarint(p, end, line)
+			&& GetString(p, end, format.file)
+			&& GetString(p, end, format.fmt)
+			&& GetString(p, end, format.types)
+			&& (format.id = id, format.line = line, true);
+	}
+
+	bool BinaryLog::ParseEvent(uint8_t type, const char* data, size_t len, Event& event) {
+		const char* p = data;
+		const char* end = data + len;
+		uint64_t id = 0;
+		uint64_t tid = 0;
+		uint64_t fid = 0;
+		uint64_t line = 0;
+		if(type == EVENT) {
+			if(!(GetVarint(p, end, id)
+					&& GetLevel(p, end, event.level)
+					&& GetVarint(p, end, tid)
+					&& GetVarint(p, end, fid)
+					&& GetFixed64(p, end, event.ticks)
+					&& GetString(p, end, event.logger))) {
+				return false;
+			}
+		}
+		else if(type == TEXT) {
+			if(!(GetLevel(p, end, event.level)
+					&& GetVarint(p, end, tid)
+					&& GetVarint(p, end, fid)
+					&& GetFixed64(p, end, event.ticks)
+					&& GetVarint(p, end, line)
+					&& GetString(p, end, event.file)
+					&& GetString(p, end, event.logger)
+					&& GetString(p, end, event.threadName))) {
+				return false;
+			}
+		}
+		else {
+			return false;
+		}
+		event.id = id;
+		event.threadId = tid;
+		event.fiberId = fid;
+		event.line = line;
+		event.args = p;
+		event.argsLen = end - p;
+		return true;
+	}
+
+	template<class T>
+	static void AppendFormat(LogStream& os, const std::string& spec, T v) {
+		char buf[128];
+		int n = snprintf(buf, sizeof(buf), spec.c_str(), v);
+		if(n < 0) {
+			return;
+		}
+		if((size_t)n < sizeof(buf)) {
+			os.append(buf, n);
+			return;
+		}
+		std::string tmp(n + 1, '\0');
+		snprintf(&tmp[0], tmp.size(), spec.c_str(), v);
+		os.append(tmp.c_str(), n);
+	}
+
+	bool BinaryLog::FormatMessage(LogStream& os, const std::string& fmt, const std::string& types
+			, const char* args, size_t len) {
+		const char* p = args;
+		const char* end = args + len;
+		const char* f = fmt.c_str();
+		const char* fend = f + fmt.size();
+		size_t index = 0;
+		std::string spec;
+		while(f < fend) {
+			const char* pct = (const char*)memchr(f, '%', fend - f);
+			if(!pct) {
+				os.append(f, fend - f);
+				break;
+			}
+			os.append(f, pct - f);
+			f = pct + 1;
+			if(f < fend && *f == '%') {
+				os.append("%", 1);
+				++f;
+				continue;
+			}
+			//保留标志、宽度和精度，长度修饰按参数的实际类型重新生成，不支持*
+			spec = "%";
+			while(f < fend && *f && strchr("-+ #0", *f)) {
+				spec.push_back(*f++);
+			}
+			while(f < fend && (isdigit(*f) || *f == '.')) {
+				spec.push_back(*f++);
+			}
+			while(f < fend && *f && strchr("hlLqjzt", *f)) {
+				++f;
+			}
+			if(f >= fend) {
+				os.append(pct, fend - pct);
+				break;
+			}
+			char conv = *f++;
+			if(!isalpha(conv) || index >= types.size()) {
+				os.append(pct, f - pct);
+				continue;
+			}
+			char type = types[index++];
+			uint64_t v = 0;
+			switch(type) {
+				case ARG_INT:
+				case ARG_UINT:
+					if(!GetVarint(p, end, v)) {
+						return false;
+					}
+					if(type == ARG_INT) {
+						v = (v >> 1) ^ (0 - (v & 1));
+					}
+					if(conv == 'c') {
+						spec.push_back('c');
+						AppendFormat(os, spec, (int)v);
+						break;
+					}
+					if(!strchr("diouxX", conv)) {
+						conv = type == ARG_INT ? 'd' : 'u';
+					}
+					spec.append("ll");
+					spec.push_back(conv);
+					if(type == ARG_INT) {
+						AppendFormat(os, spec, (long long)v);
+					}
+					else {
+						AppendFormat(os, spec, (unsigned long long)v);
+					}
+					break;
+				case ARG_DOUBLE:
+					{
+						if(!GetFixed64(p, end, v)) {
+							return false;
+						}
+						double d = 0;
+						memcpy(&d, &v, sizeof(d));
+						spec.push_back(strchr("eEfFgGaA", conv) ? conv : 'g');
+						AppendFormat(os, spec, d);
+					}
+					break;
+				case ARG_STRING:
+					{
+						const char* s = nullptr;
+						size_t slen = 0;
+						if(!GetString(p, end, s, slen)) {
+							return false;
+						}
+						if(spec.size() == 1) {
+							os.append(s, slen);
+						}
+						else {
+							spec.push_back('s');
+							AppendFormat(os, spec, std::string(s, slen).c_str());
+						}
+					}
+					break;
+				case ARG_POINTER:
+					if(!GetVarint(p, end, v)) {
+						return false;
+					}
+					if(conv == 'p') {
+						spec.push_back('p');
+						AppendFormat(os, spec, (void*)(uintptr_t)v);
+					}
+					else {
+						spec.append("ll");
+						spec.push_back(strchr("ouxX", conv) ? conv : 'x');
+						AppendFormat(os, spec, (unsigned long long)v);
+					}
+					break;
+				default:
+					return false;
+			}
+		}
+		return true;
+	}
+
+	BinaryLogAppender::BinaryLogAppender(const std::string& filename, size_t buffer_size
+			, size_t max_buffers, Overflow overflow, uint32_t flush_interval, uint32_t sample_rate)
+		:AsyncLogAppender(filename, buffer_size, max_buffers, overflow, flush_interval, sample_rate) {
+		//提前校准，避免第一次写出时在后台线程里等待
+		BinaryLog::GetTicksPerSecond();
+	}
+
+	BinaryLogAppender::~BinaryLogAppender() {
+		//后台线程会调用beforeWrite()，必须在派生类析构之前停止
+		stop();
+	}
+
+	void BinaryLogAppender::log(const Logger::ptr& logger, LogLevel::Level level, const LogEvent::ptr& event) {
+		if(level >= m_level) {
+			static thread_local std::string t_record;
+			t_record.clear();
+			BinaryLog::EncodeText(t_record, level, event);
+			logBinary(logger, level, t_record.data(), t_record.size());
+		}
+	}
+
+	void BinaryLogAppender::logBinary(const Logger::ptr& logger, LogLevel::Level level, const char* data, size_t len) {
+		if(level >= m_level) {
+			//截断的记录无法解码，超过缓冲区大小时直接丢弃
+			if(len > getBufferSize()) {
+				++m_dropped;
+				return;
+			}
+			append(level, data, len);
+		}
+	}
+
+	void BinaryLogAppender::beforeWrite() {
+		m_meta.clear();
+		uint64_t generation = getGeneration();
+		if(generation != m_generation) {
+			m_generation = generation;
+			m_formatCount = 0;
+			BinaryLog::EncodeHeader(m_meta);
+		}
+		else {
+			BinaryLog::EncodeSync(m_meta);
+		}
+		//缓冲区交换之后才读取数量，缓冲区中日志用到的格式串都已经注册
+		size_t count = BinaryLog::GetFormatCount();
+		while(m_formatCount < count) {
+			const BinaryLog::Format* f = BinaryLog::GetFormat(++m_formatCount);
+			if(f) {
+				BinaryLog::EncodeFormat(m_meta, *f);
+			}
+		}
+		writeData(m_meta.data(), m_meta.size());
+	}
+
+	std::string BinaryLogAppender::toYamlString() {
+		YAML::Node node = YAML::Load(AsyncLogAppender::toYamlString());
+		node["type"] = "BinaryLogAppender";
+		node.remove("formatter");
+		std::stringstream ss;
+		ss << node;
+		return ss.str();
+	}
+
+	BinaryLogDecoder::BinaryLogDecoder(const std::string& pattern)
+		:m_formatter(new LogFormatter(pattern)) {
+	}
+
+	int64_t BinaryLogDecoder::decode(const char* data, size_t len, std::ostream& os) {
+		size_t offset = 0;
+		while(offset < len) {
+			uint8_t type = 0;
+			const char* payload = nullptr;
+			size_t payload_len = 0;
+			int64_t rt = BinaryLog::ReadRecord(data + offset, len - offset, type, payload, payload_len);
+			if(rt < 0) {
+				return -1;
+			}
+			if(rt == 0) {
+				break;
+			}
+			offset += rt;
+			const char* p = payload;
+			const char* end = payload + payload_len;
+			switch(type) {
+				case BinaryLog::HEADER:
+					{
+						uint32_t magic = 0;
+						if(payload_len < sizeof(magic) + 1) {
+							return -1;
+						}
+						memcpy(&magic, p, sizeof(magic));
+						p += sizeof(magic) + 1;
+						if(magic != BinaryLog::MAGIC || !GetFixed64(p, end, m_ticksPerSecond)
+								|| !GetFixed64(p, end, m_syncTicks) || !GetFixed64(p, end, m_syncNs)) {
+							return -1;
+						}
+						if(m_ticksPerSecond == 0) {
+							m_ticksPerSecond = 1000000000;
+						}
+						//新的会话，格式串编号重新开始
+						m_formats.clear();
+					}
+					break;
+				case BinaryLog::FORMAT:
+					{
+						BinaryLog::Format f;
+						if(!BinaryLog::ParseFormat(payload, payload_len, f)) {
+							return -1;
+						}
+						m_formats[f.id] = f;
+					}
+					break;
+				case BinaryLog::SYNC:
+					if(!GetFixed64(p, end, m_syncTicks) || !GetFixed64(p, end, m_syncNs)) {
+						return -1;
+					}
+					break;
+				case BinaryLog::EVENT:
+				case BinaryLog::TEXT:
+					{
+						BinaryLog::Event ev;
+						if(!BinaryLog::ParseEvent(type, payload, payload_len, ev)) {
+							return -1;
+						}
+						++m_events;
+						output(type, ev, os);
+					}
+					break;
+				default:
+					//新版本增加的记录类型，跳过
+					break;
+			}
+		}
+		return offset;
+	}
+
+	void BinaryLogDecoder::output(uint8_t type, const BinaryLog::Event& ev, std::ostream& os) {
+		//计数换算成系统时间，同步点之前写入的日志计数差为负数
+		int64_t delta = (int64_t)(ev.ticks - m_syncTicks);
+		int64_t ns = (int64_t)m_syncNs + (int64_t)((double)delta * 1e9 / m_ticksPerSecond);
+		const char* file = ev.file.c_str();
+		int32_t line = ev.line;
+		const BinaryLog::Format* fmt = nullptr;
+		if(type == BinaryLog::EVENT) {
+			auto it = m_formats.find(ev.id);
+			if(it != m_formats.end()) {
+				fmt = &it->second;
+				file = fmt->file.c_str();
+				line = fmt->line;
+			}
+		}
+		Logger::ptr logger = getLogger(ev.logger);
+		LogEvent::ptr event(new LogEvent(logger, ev.level, file, line, 0, ev.threadId, ev.fiberId
+					, ns / 1000000000, ev.threadName));
+		if(type == BinaryLog::TEXT) {
+			event->getSS().append(ev.args, ev.argsLen);
+		}
+		else if(!fmt) {
+			++m_errors;
+			event->getSS() << "<unknown format id " << ev.id << ">";
+		}
+		else if(!BinaryLog::FormatMessage(event->getSS(), fmt->fmt, fmt->types, ev.args, ev.argsLen)) {
+			++m_errors;
+			event->getSS() << " <truncated arguments>";
+		}
+		m_stream.reset();
+		m_formatter->format(m_stream, logger, ev.level, event);
+		os.write(m_stream.data(), m_stream.size());
+	}
+
+	Logger::ptr BinaryLogDecoder::getLogger(const std::string& name) {
+		auto it = m_loggers.find(name);
+		if(it != m_loggers.end()) {
+			return it->second;
+		}
+		Logger::ptr logger(new Logger(name));
+		m_loggers[name] = logger;
+		return logger;
+	}
+
+}
@@ -0,0 +1,248 @@
+#ifndef __SYLAR_BINLOG_H__
+#define __SYLAR_BINLOG_H__
+
+#include<memory>
+#include<string>
+#include<vector>
+#include<map>
+#include<atomic>
+#include<type_traits>
+#include<stdint.h>
+#include "log.h"
+
+//二进制日志，写日志的线程只记录格式串编号和原始参数，文本由sylar_logdecode离线还原
+//fmt必须是字符串字面量，同一调用点的参数类型固定，支持整数、浮点数、枚举、字符串和指针
+//输出到非BinaryLogAppender时在当前线程还原成文本，结果与SYLAR_LOG_FMT_XX一致
+#define SYLAR_BINLOG_LEVEL(logger, level, fmt, ...) \
+	if(logger->getLevel() <= level) \
+		do { \
+			static std::atomic<uint32_t> s_sylar_binlog_id(0); \
+			sylar::BinaryLog::Log(logger, level, s_sylar_binlog_id, __FILE__, __LINE__, fmt, ##__VA_ARGS__); \
+		} while(0)
+
+#define SYLAR_BINLOG_DEBUG(logger, fmt, ...) SYLAR_BINLOG_LEVEL(logger, sylar::LogLevel::DEBUG, fmt, ##__VA_ARGS__)
+#define SYLAR_BINLOG_INFO(logger, fmt, ...) SYLAR_BINLOG_LEVEL(logger, sylar::LogLevel::INFO, fmt, ##__VA_ARGS__)
+#define SYLAR_BINLOG_WARN(logger, fmt, ...) SYLAR_BINLOG_LEVEL(logger, sylar::LogLevel::WARN, fmt, ##__VA_ARGS__)
+#define SYLAR_BINLOG_ERROR(logger, fmt, ...) SYLAR_BINLOG_LEVEL(logger, sylar::LogLevel::ERROR, fmt, ##__VA_ARGS__)
+#define SYLAR_BINLOG_FATAL(logger, fmt, ...) SYLAR_BINLOG_LEVEL(logger, sylar::LogLevel::FATAL, fmt, ##__VA_ARGS__)
+
+namespace sylar {
+
+	//二进制日志记录的编码
+	//文件由连续的记录组成，每条记录为 类型(1字节) + 内容长度(varint) + 内容，整数使用varint，有符号整数先做zigzag
+	//HEADER	会话开始：magic(4字节) 版本(1字节) 每秒计数(8字节) 计数(8字节) 纳秒时间(8字节)，之后的格式串编号重新计算
+	//FORMAT	格式串定义：编号 级别 行号 文件名 格式串 参数类型
+	//SYNC		时间同步点：计数(8字节) 纳秒时间(8字节)
+	//EVENT		日志：编号 级别 线程id 协程id 计数(8字节) logger名称 参数
+	//TEXT		普通日志：级别 线程id 协程id 计数(8字节) 行号 文件名 logger名称 线程名称 内容
+	class BinaryLog {
+	public:
+		enum RecordType {
+			HEADER = 1,
+			FORMAT = 2,
+			SYNC = 3,
+			EVENT = 4,
+			TEXT = 5
+		};
+		//参数类型
+		enum ArgType {
+			ARG_INT = 'i',
+			ARG_UINT = 'u',
+			ARG_DOUBLE = 'd',
+			ARG_STRING = 's',
+			ARG_POINTER = 'p'
+		};
+		static const uint32_t MAGIC = 0x424c5953;		//"SYLB"
+		static const uint8_t VERSION = 1;
+
+		struct Format {
+			uint32_t id = 0;
+			LogLevel::Level level = LogLevel::UNKNOW;
+			int32_t line = 0;
+			std::string file;
+			std::string fmt;
+			std::string types;
+		};
+		//解析出的一条EVENT或TEXT记录，字符串指向记录内部
+		struct Event {
+			uint32_t id = 0;				//TEXT为0
+			LogLevel::Level level = LogLevel::UNKNOW;
+			uint32_t threadId = 0;
+			uint32_t fiberId = 0;
+			uint64_t ticks = 0;
+			int32_t line = 0;
+			std::string file;
+			std::string logger;
+			std::string threadName;
+			const char* args = nullptr;		//EVENT的参数，TEXT的内容
+			size_t argsLen = 0;
+		};
+
+		//记录一条日志，调用点第一次执行时注册格式串
+		template<class... Args>
+		static void Log(const Logger::ptr& logger, LogLevel::Level level, std::atomic<uint32_t>& id
+				, const char* file, int32_t line, const char* fmt, const Args&... args) {
+			uint64_t ticks = Now();
+			Encoder& e = Encoder::GetThis();
+			e.reset();
+			EncodeArgs(e, args...);
+			uint32_t v = id.load(std::memory_order_relaxed);
+			if(v == 0) {
+				//并发第一次执行时可能注册两次，多出的定义不影响解码
+				v = RegisterFormat(level, file, line, fmt, e.types());
+				id.store(v, std::memory_order_relaxed);
+			}
+			e.finishEvent(v, level, ticks, logger->getName());
+			logger->logBinary(logger, level, e.data(), e.size());
+		}
+
+		//注册格式串，返回从1开始的编号
+		static uint32_t RegisterFormat(LogLevel::Level level, const char* file, int32_t line
+				, const char* fmt, const std::string& types);
+		//已注册的格式串数量
+		static size_t GetFormatCount();
+		//格式串注册后不会释放，返回的指针一直有效，不存在时返回nullptr
+		static const Format* GetFormat(uint32_t id);
+
+		//当前时间计数，x86上为rdtsc，其余平台为单调时钟纳秒
+		static uint64_t Now();
+		//每秒的计数，第一次调用时校准
+		static uint64_t GetTicksPerSecond();
+		//同时读取计数和系统时间（纳秒）
+		static void GetSyncPoint(uint64_t& ticks, uint64_t& ns);
+
+		//编码各类记录，写入out末尾
+		static void EncodeHeader(std::string& out);
+		static void EncodeFormat(std::string& out, const Format& format);
+		static void EncodeSync(std::string& out);
+		static void EncodeText(std::string& out, LogLevel::Level level, const LogEvent::ptr& event);
+
+		//从data中取一条完整记录，返回记录总长度，数据不完整返回0，格式错误返回-1
+		static int64_t ReadRecord(const char* data, size_t len, uint8_t& type, const char*& payload, size_t& payload_len);
+		static bool ParseFormat(const char* data, size_t len, Format& format);
+		static bool ParseEvent(uint8_t type, const char* data, size_t len, Event& event);
+		//按格式串和参数类型把参数还原成文本，参数与格式串不一致时尽量输出，返回参数是否完整
+		static bool FormatMessage(LogStream& os, const std::string& fmt, const std::string& types
+				, const char* args, size_t len);
+	public:
+		//线程私有的编码缓冲区，复用内存
+		class Encoder {
+		public:
+			static Encoder& GetThis();
+			void reset() { m_args.clear(); m_types.clear();}
+			const std::string& types() const { return m_types;}
+			const char* data() const { return m_record.data();}
+			size_t size() const { return m_record.size();}
+
+			void putInt(int64_t v) { m_types.push_back(ARG_INT); PutVarint(m_args, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));}
+			void putUint(uint64_t v) { m_types.push_back(ARG_UINT); PutVarint(m_args, v);}
+			void putDouble(double v) { m_types.push_back(ARG_DOUBLE); m_args.append((const char*)&v, sizeof(v));}
+			void putString(const char* v, size_t len) {
+				m_types.push_back(ARG_STRING);
+				PutVarint(m_args, len);
+				m_args.append(v, len);
+			}
+			void putPointer(const void* v) { m_types.push_back(ARG_POINTER); PutVarint(m_args, (uint64_t)(uintptr_t)v);}
+			//把参数加上记录头拼成完整的EVENT记录
+			void finishEvent(uint32_t id, LogLevel::Level level, uint64_t ticks, const std::string& logger);
+		private:
+			std::string m_args;
+			std::string m_types;
+			std::string m_record;
+		};
+
+		static void PutVarint(std::string& out, uint64_t v) {
+			char buf[10];
+			size_t n = 0;
+			while(v >= 0x80) {
+				buf[n++] = (char)(v | 0x80);
+				v >>= 7;
+			}
+			buf[n++] = (char)v;
+			out.append(buf, n);
+		}
+	private:
+		static void EncodeArgs(Encoder& e) {}
+		template<class T, class... Args>
+		static void EncodeArgs(Encoder& e, const T& v, const Args&... args) {
+			EncodeArg(e, v);
+			EncodeArgs(e, args...);
+		}
+
+		template<class T>
+		static typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+		EncodeArg(Encoder& e, T v) { e.putInt(v);}
+		template<class T>
+		static typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type
+		EncodeArg(Encoder& e, T v) { e.putUint(v);}
+		template<class T>
+		static typename std::enable_if<std::is_enum<T>::value>::type
+		EncodeArg(Encoder& e, T v) { e.putInt((int64_t)v);}
+		template<class T>
+		static typename std::enable_if<std::is_floating_point<T>::value>::type
+		EncodeArg(Encoder& e, T v) { e.putDouble(v);}
+		template<class T>
+		static typename std::enable_if<std::is_pointer<T>::value>::type
+		EncodeArg(Encoder& e, T v) { e.putPointer((const void*)v);}
+		static void EncodeArg(Encoder& e, const char* v) {
+			if(v) {
+				e.putString(v, strlen(v));
+			}
+			else {
+				e.putString("(null)", 6);
+			}
+		}
+		static void EncodeArg(Encoder& e, char* v) { EncodeArg(e, (const char*)v);}
+		static void EncodeArg(Encoder& e, const std::string& v) { e.putString(v.c_str(), v.size());}
+	};
+
+	//二进制日志Appender，在AsyncLogAppender的缓冲和后台写出基础上，写入的是编码后的记录而不是文本
+	//后台线程在每批数据之前写出时间同步点和新注册的格式串，新文件（包括reopen之后）先写会话头和全部格式串
+	//普通日志宏产生的日志以TEXT记录保存，不经过格式器
+	class BinaryLogAppender : public AsyncLogAppender {
+	public:
+		typedef std::shared_ptr<BinaryLogAppender> ptr;
+		BinaryLogAppender(const std::string& filename, size_t buffer_size = 4 * 1024 * 1024
+				, size_t max_buffers = 16, Overflow overflow = DROP, uint32_t flush_interval = 1000
+				, uint32_t sample_rate = 100);
+		~BinaryLogAppender();
+		void log(const Logger::ptr& logger, LogLevel::Level level, const LogEvent::ptr& event) override;
+		void logBinary(const Logger::ptr& logger, LogLevel::Level level, const char* data, size_t len) override;
+		std::string toYamlString() override;
+	protected:
+		void beforeWrite() override;
+	private:
+		uint64_t m_generation = (uint64_t)-1;		//已写过会话头的文件
+		size_t m_formatCount = 0;								//当前文件已写出的格式串数量
+		std::string m_meta;
+	};
+
+	//把二进制日志还原成文本，按LogFormatter的模式串输出，%N只对普通日志有效
+	class BinaryLogDecoder {
+	public:
+		BinaryLogDecoder(const std::string& pattern);
+		//解码data中的完整记录并输出到os，返回消耗的字节数，末尾不完整的记录留到下次
+		//遇到无法解析的数据返回-1
+		int64_t decode(const char* data, size_t len, std::ostream& os);
+
+		uint64_t getEventCount() const { return m_events;}
+		//缺少格式串定义或者参数不完整的日志数
+		uint64_t getErrorCount() const { return m_errors;}
+	private:
+		void output(uint8_t type, const BinaryLog::Event& event, std::ostream& os);
+		Logger::ptr getLogger(const std::string& name);
+	private:
+		LogFormatter::ptr m_formatter;
+		std::map<uint32_t, BinaryLog::Format> m_formats;
+		std::map<std::string, Logger::ptr> m_loggers;
+		LogStream m_stream;
+		uint64_t m_ticksPerSecond = 1000000000;
+		uint64_t m_syncTicks = 0;
+		uint64_t m_syncNs = 0;
+		uint64_t m_events = 0;
+		uint64_t m_errors = 0;
+	};
+
+}
+
+#endif
@@ -2,6 +2,50 @@
 
 namespace sylar {
 	//Config::ConfigVarMap Config::s_datas;
+	
+	//뵥Ԫľ̬ʼдǳʼ
+	static std::atomic<uint32_t> s_config_index(0);
+	static std::atomic<uint64_t> s_config_version(0);
+	
+	//߳˽еֵ棬±
+	//·ֻPOḎ߳߳˽жĳʼ
+	struct ConfigCache {
+		~ConfigCache();
+		std::vector<ConfigVarBase::CacheEntry> entries;
+	};
+	static thread_local ConfigVarBase::CacheEntry* t_config_entries = nullptr;
+	static thread_local size_t t_config_entries_size = 0;
+	static thread_local bool t_config_cache_destroyed = false;
+	static thread_local ConfigCache t_config_cache;
+	
+	ConfigCache::~ConfigCache() {
+		t_config_entries = nullptr;
+		t_config_entries_size = 0;
+		t_config_cache_destroyed = true;
+	}
+	
+	ConfigVarBase::CacheEntry* ConfigVarBase::GetCacheEntry(uint32_t index) {
+		if(index < t_config_entries_size) {
+			return &t_config_entries[index];
+		}
+		if(t_config_cache_destroyed) {
+			return nullptr;
+		}
+		//һչеȫvectorݲӰѷصֵãֵshared_ptr
+		std::vector<CacheEntry>& entries = t_config_cache.entries;
+		entries.resize(std::max<size_t>(index + 1, s_config_index.load(std::memory_order_relaxed)));
+		t_config_entries = &entries[0];
+		t_config_entries_size = entries.size();
+		return &t_config_entries[index];
+	}
+	
+	uint64_t ConfigVarBase::NextVersion() {
+		return s_config_version.fetch_add(1, std::memory_order_relaxed) + 1;
+	}
+	
+	uint32_t ConfigVarBase::NextIndex() {
+		return s_config_index.fetch_add(1, std::memory_order_relaxed);
+	}
 		
   ConfigVarBase::ptr Config::LookupBase(const std::string& name) {
   	RWMutexType::ReadLock lock(GetMutex());
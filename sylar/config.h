@@ -14,6 +14,7 @@
 #include<unordered_map>
 #include<unordered_set>
 #include<functional>
+#include<atomic>
 #include "thread.h"
 
 namespace sylar {
@@ -22,7 +23,8 @@ namespace sylar {
 		typedef std::shared_ptr<ConfigVarBase> ptr;
 		ConfigVarBase(const std::string& name, const std::string& description = "")
 			:m_name(name)
-			, m_description(description) {
+			, m_description(description)
+			, m_index(NextIndex()) {
 				std::transform(m_name.begin(), m_name.end(), m_name.begin(), ::tolower);
 			}
 			virtual ~ConfigVarBase() { }
@@ -33,9 +35,22 @@ namespace sylar {
 		virtual std::string toString() = 0;
 		virtual bool fromString(const std::string& val) = 0;
 		virtual std::string getTypeName() const = 0;
+	public:
+		//߳˽еֵversionǰ汾һʱvalueǵǰֵ
+		struct CacheEntry {
+			uint64_t version = 0;
+			std::shared_ptr<const void> value;
+		};
+	protected:
+		//ǰ߳±ΪindexĻ߳˽лѾ߳˳׶Σʱnullptr
+		static CacheEntry* GetCacheEntry(uint32_t index);
+		//ȫֵİ汾ţÿ޸ֵһ°汾1ʼ
+		static uint64_t NextVersion();
+		static uint32_t NextIndex();
 	protected:
 		std::string m_name;
 		std::string m_description;
+		uint32_t m_index;		//߳˽ле±꣬ÿΨһ
 	};
 	
 	//F form_type T to_type
@@ -250,17 +265,18 @@ namespace sylar {
 			,const T& default_value
 			,const std::string& description = "")
 		:ConfigVarBase(name, description)
-		,m_val(default_value) {
+		,m_val(new T(default_value))
+		,m_version(NextVersion()) {
 		}
 		
 	  std::string toString() override {
 	  	try {
 	  		//return boost::lexical_cast<std::string>(m_val);
 	  		RWMutexType::ReadLock lock(m_mutex);
-	  		return ToStr()(m_val);
+	  		return ToStr()(*m_val);
 	  	} catch (std::exception& e) {
 	  		SYLAR_LOG_ERROR(SYLAR_LOG_ROOT()) << "ConfigVar::toString exception"
-	  			<< e.what() << " convert: " << typeid(m_val).name() << " to string";
+	  			<< e.what() << " convert: " << typeid(T).name() << " to string";
 	  	}
 	  	return "";
 	  }
@@ -270,29 +286,49 @@ namespace sylar {
 	  		setValue(FromStr()(val));
 	  	} catch (std::exception& e) {
 	  		SYLAR_LOG_ERROR(SYLAR_LOG_ROOT()) << "ConfigVar::toString exception"
-	  			<< e.what() << " convert: string to " << typeid(m_val).name()
+	  			<< e.what() << " convert: string to " << typeid(T).name()
 	  			<< " - " << val;
 	  	}
 	  	return false;
 	  }
 	  
 	  const T getValue()  {
-	  	RWMutexType::ReadLock lock(m_mutex); 
-	  	return m_val;
+	  	CacheEntry* entry = GetCacheEntry(m_index);
+	  	if(!entry) {
+	  		//߳˽лѾʱڿsetValueͷžֵ
+	  		RWMutexType::ReadLock lock(m_mutex);
+	  		return *m_val;
+	  	}
+	  	return getCachedValue(entry);
 	  }
 	  
+	  //ȡǰֵ汾δ仯ʱֻһԭӶ
+	  //ָǰֻ̻߳գڱ߳һζȡ֮ǰЧ̻ܿ߳߿Эл
+	  //߳˳׶߳˽лѾʱ˻ΪȡһsetValue֮ǰЧ
+	  const T& getValueRef() {
+	  	CacheEntry* entry = GetCacheEntry(m_index);
+	  	if(!entry) {
+	  		RWMutexType::ReadLock lock(m_mutex);
+	  		return *m_val;
+	  	}
+	  	return getCachedValue(entry);
+	  }
+	  
+	  //ֵΪµֻշɿ̵߳Ļ涼ºͷ
 	  void setValue(const T& v) {
 	  	{ //򣬷
   			RWMutexType::ReadLock lock(m_mutex);
-  			if(v == m_val) {
+  			if(v == *m_val) {
   				return;
   			}
   			for(auto& i : m_cbs) {
-  				i.second(m_val, v);
+  				i.second(*m_val, v);
   			}
   		}
+  		std::shared_ptr<const T> val(new T(v));
 	  	RWMutexType::WriteLock lock(m_mutex);
-	  	m_val = v;
+	  	m_val.swap(val);
+	  	m_version.store(NextVersion(), std::memory_order_release);
 	  }
 	  std::string getTypeName() const override { return typeid(T).name();}
 	  
@@ -319,9 +355,20 @@ namespace sylar {
 	  	RWMutexType::WriteLock lock(m_mutex);
 	  	m_cbs.clear();
 	  }
+	private:
+		//汾仯ʱڶˢµǰ̵߳Ļ
+		const T& getCachedValue(CacheEntry* entry) {
+			if(entry->version != m_version.load(std::memory_order_acquire)) {
+				RWMutexType::ReadLock lock(m_mutex);
+				entry->value = m_val;
+				entry->version = m_version.load(std::memory_order_relaxed);
+			}
+			return *static_cast<const T*>(entry->value.get());
+		}
 	private:
 		RWMutexType m_mutex;
-		T m_val;
+		std::shared_ptr<const T> m_val;		//ǰֵֻգ޸ʱ滻
+		std::atomic<uint64_t> m_version;	//m_valİ汾дڸ
 		//ص飬uint64_t keyҪΨһһhash
 		std::map<uint64_t, on_change_cb> m_cbs;
 	};
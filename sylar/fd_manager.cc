@@ -94,6 +94,9 @@ namespace sylar {
 		}
 		lock.unlock();
 		RWMutexType::WriteLock lock2(m_mutex);
+		if((int)m_datas.size() <= fd) {
+			m_datas.resize(fd * 1.5);
+		}
 		FdCtx::ptr ctx(new FdCtx(fd));
 		m_datas[fd] = ctx;
 		return ctx;
@@ -4,6 +4,10 @@
 #include "log.h"
 #include "scheduler.h"
 #include<atomic>
+#include<sys/mman.h>
+#include<string.h>
+#include<errno.h>
+#include<algorithm>
 
 namespace sylar {
 	
@@ -18,18 +22,239 @@ namespace sylar {
 		
 	static ConfigVar<uint32_t>::ptr g_fiber_stack_size = 
 		Config::Lookup<uint32_t>("fiber.stack_size", 1024 * 1024, "fiber stack size");
-	class MallocStackAllocator {
+	static ConfigVar<std::string>::ptr g_fiber_stack_allocator =
+		Config::Lookup<std::string>("fiber.stack_allocator", "mmap", "fiber stack allocator, malloc or mmap");
+	static ConfigVar<uint32_t>::ptr g_fiber_stack_pool_size =
+		Config::Lookup<uint32_t>("fiber.stack_pool_size", 64, "max cached fiber stacks per thread");
+	static ConfigVar<bool>::ptr g_fiber_stack_madvise =
+		Config::Lookup<bool>("fiber.stack_madvise", false, "madvise(MADV_DONTNEED) stacks returned to pool");
+	static ConfigVar<uint32_t>::ptr g_fiber_shared_stack_size =
+		Config::Lookup<uint32_t>("fiber.shared_stack_size", 8 * 1024 * 1024, "shared fiber run stack size");
+	static ConfigVar<uint32_t>::ptr g_fiber_shared_stack_count =
+		Config::Lookup<uint32_t>("fiber.shared_stack_count", 16, "shared fiber run stacks per scheduler");
+	
+	//ջӿ
+	class StackAllocator {
+	 public:
+	 	virtual ~StackAllocator() {}
+	 	virtual void* alloc(size_t size) = 0;
+	 	virtual void dealloc(void* vp, size_t size) = 0;
+	 	//黹ʱͷҳֻҳջ֧
+	 	virtual void release(void* vp, size_t size) {}
+	};
+	
+	class MallocStackAllocator : public StackAllocator {
 	 public:
-	 	static void* Alloc(size_t size) {
+	 	void* alloc(size_t size) override {
 	 		return malloc(size);
 	 	}
 	 	
-	 	static void Dealloc(void* vp, size_t size) {
+	 	void dealloc(void* vp, size_t size) override {
 	 		return free(vp);
 	 	}
 	};
 	
-	using StackAllocator = MallocStackAllocator;
+	//mmapջ͵ַһһPROT_NONEҳջʱֱӴSIGSEGVǲȻڴ
+	//MAP_NORESERVEַֻռ䣬ҳڵһηʱύ
+	class MmapStackAllocator : public StackAllocator {
+	 public:
+	 	void* alloc(size_t size) override {
+	 		size_t page = GetPageSize();
+	 		void* vp = mmap(nullptr, size + page, PROT_READ | PROT_WRITE
+	 			, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+	 		if(vp == MAP_FAILED) {
+	 			SYLAR_LOG_ERROR(g_logger) << "mmap fiber stack size=" << size
+	 				<< " errno=" << errno << " " << strerror(errno);
+	 			return nullptr;
+	 		}
+	 		if(mprotect(vp, page, PROT_NONE)) {
+	 			SYLAR_LOG_ERROR(g_logger) << "mprotect fiber stack guard page errno="
+	 				<< errno << " " << strerror(errno);
+	 		}
+	 		return (char*)vp + page;
+	 	}
+	 	
+	 	void dealloc(void* vp, size_t size) override {
+	 		size_t page = GetPageSize();
+	 		munmap((char*)vp - page, size + page);
+	 	}
+	 	
+	 	void release(void* vp, size_t size) override {
+	 		madvise(vp, size, MADV_DONTNEED);
+	 	}
+	 	
+	 	static size_t GetPageSize() {
+	 		static size_t s_page_size = sysconf(_SC_PAGESIZE);
+	 		return s_page_size;
+	 	}
+	};
+	
+	static MallocStackAllocator s_malloc_allocator;
+	static MmapStackAllocator s_mmap_allocator;
+	
+	static StackAllocator* s_stack_allocator = &s_mmap_allocator;
+	static uint32_t s_stack_pool_size = 64;
+	static bool s_stack_madvise = false;
+	
+	static StackAllocator* GetStackAllocator(const std::string& name) {
+		if(name == "malloc") {
+			return &s_malloc_allocator;
+		}
+		if(name != "mmap") {
+			SYLAR_LOG_ERROR(g_logger) << "invalid fiber.stack_allocator=" << name
+				<< ", use mmap";
+		}
+		return &s_mmap_allocator;
+	}
+	
+	struct _FiberIniter {
+		_FiberIniter() {
+			s_stack_allocator = GetStackAllocator(g_fiber_stack_allocator->getValue());
+			s_stack_pool_size = g_fiber_stack_pool_size->getValue();
+			s_stack_madvise = g_fiber_stack_madvise->getValue();
+			g_fiber_stack_allocator->addListener([](const std::string& old_value, const std::string& new_value){
+				s_stack_allocator = GetStackAllocator(new_value);
+			});
+			g_fiber_stack_pool_size->addListener([](const uint32_t& old_value, const uint32_t& new_value){
+				s_stack_pool_size = new_value;
+			});
+			g_fiber_stack_madvise->addListener([](const bool& old_value, const bool& new_value){
+				s_stack_madvise = new_value;
+			});
+		}
+	};
+	
+	static _FiberIniter s_fiber_initer;
+	
+	//߳˽еջأЭʱջȻصУһͬСЭֱӸãÿmmap/munmap
+	class StackPool {
+	 public:
+	 	struct Stack {
+	 		StackAllocator* allocator;
+	 		void* stack;
+	 		size_t size;
+	 	};
+	 	
+	 	~StackPool();
+	 	
+	 	void* alloc(size_t size, StackAllocator*& allocator) {
+	 		for(size_t i = m_stacks.size(); i > 0; --i) {
+	 			Stack& s = m_stacks[i - 1];
+	 			if(s.size == size && s.allocator == s_stack_allocator) {
+	 				void* vp = s.stack;
+	 				allocator = s.allocator;
+	 				m_stacks.erase(m_stacks.begin() + (i - 1));
+	 				return vp;
+	 			}
+	 		}
+	 		allocator = s_stack_allocator;
+	 		return allocator->alloc(size);
+	 	}
+	 	
+	 	void dealloc(StackAllocator* allocator, void* vp, size_t size) {
+	 		if(m_stacks.size() >= s_stack_pool_size) {
+	 			allocator->dealloc(vp, size);
+	 			return;
+	 		}
+	 		if(s_stack_madvise) {
+	 			allocator->release(vp, size);
+	 		}
+	 		m_stacks.push_back(Stack{allocator, vp, size});
+	 	}
+	 private:
+	 	std::vector<Stack> m_stacks;
+	};
+	
+	static thread_local StackPool t_stack_pool;
+	//߳˳ʱڲЭ֮黹ջֱͷ
+	static thread_local bool t_stack_pool_destroyed = false;
+	
+	StackPool::~StackPool() {
+		t_stack_pool_destroyed = true;
+		for(auto& i : m_stacks) {
+			i.allocator->dealloc(i.stack, i.size);
+		}
+	}
+	
+	static void* AllocStack(size_t size, StackAllocator*& allocator) {
+		if(t_stack_pool_destroyed) {
+			allocator = s_stack_allocator;
+			return allocator->alloc(size);
+		}
+		return t_stack_pool.alloc(size, allocator);
+	}
+	
+	static void DeallocStack(StackAllocator* allocator, void* vp, size_t size) {
+		if(t_stack_pool_destroyed) {
+			allocator->dealloc(vp, size);
+			return;
+		}
+		t_stack_pool.dealloc(allocator, vp, size);
+	}
+	
+	//ջownerΪջϵǰŻԾݵЭ
+	//Эջִڼmutexͬһջͬһʱֻһִ߳
+	struct SharedStack {
+		Mutex mutex;
+		char* stack = nullptr;
+		size_t size = 0;
+		Fiber* owner = nullptr;
+	};
+	
+	SharedStackSet::~SharedStackSet() {
+		for(auto ss : m_stacks) {
+			if(ss->owner) {
+				SYLAR_LOG_WARN(g_logger) << "shared stack still used by fiber id=" << ss->owner->getId();
+				continue;
+			}
+			s_mmap_allocator.dealloc(ss->stack, ss->size);
+			delete ss;
+		}
+	}
+	
+	void SharedStackSet::init() {
+		Mutex::Lock lock(m_mutex);
+		if(!m_stacks.empty()) {
+			return;
+		}
+		uint32_t count = std::max(g_fiber_shared_stack_count->getValue(), (uint32_t)1);
+		size_t size = g_fiber_shared_stack_size->getValue();
+		for(uint32_t i = 0; i < count; ++i) {
+			SharedStack* ss = new SharedStack;
+			ss->stack = (char*)s_mmap_allocator.alloc(size);
+			SYLAR_ASSERT2(ss->stack, "alloc shared fiber stack");
+			ss->size = size;
+			m_stacks.push_back(ss);
+		}
+		m_init = true;
+	}
+	
+	//㿪ʼһûռõջ߳ͬһջ
+	SharedStack* SharedStackSet::acquire(bool wait) {
+		if(!m_init) {
+			init();
+		}
+		size_t n = m_stacks.size();
+		size_t start = m_next++;
+		for(size_t i = 0; i < n; ++i) {
+			SharedStack* ss = m_stacks[(start + i) % n];
+			if(ss->mutex.tryLock()) {
+				return ss;
+			}
+		}
+		if(!wait) {
+			return nullptr;
+		}
+		SharedStack* ss = m_stacks[start % n];
+		ss->mutex.lock();
+		return ss;
+	}
+	
+	//̹һ飬ѾгЭ̿лԾջϣڽڲͷ
+	static SharedStackSet* GetSharedStacks() {
+		static SharedStackSet* s_shared_stacks = new SharedStackSet;
+		return s_shared_stacks;
+	}
 	
 	uint64_t Fiber::GetFiberId() {
 		if(t_fiber) {
@@ -42,34 +267,33 @@ namespace sylar {
 		m_state = EXEC;
 		SetThis(this);
 		
-		if(getcontext(&m_ctx)) { //ǰ߳ĸm_ctx
-			SYLAR_ASSERT2(false, "getcontext");
-		}
-		
 		++s_fiber_count;
 		
 		SYLAR_LOG_DEBUG(g_logger) << " Fiber::Fiber";
 	}
 	
-	Fiber::Fiber(std::function<void()> cb, size_t stacksize, bool use_caller) 
+	Fiber::Fiber(std::function<void()> cb, size_t stacksize, bool use_caller, bool shared_stack) 
 		:m_id(++s_fiber_id)
 		,m_cb(cb){
 		++s_fiber_count;
-		m_stacksize = stacksize ? stacksize : g_fiber_stack_size->getValue();
-		
-		m_stack = StackAllocator::Alloc(m_stacksize);
-		if(getcontext(&m_ctx)) {
-			SYLAR_ASSERT2(false, "getcontext");
+#ifdef SYLAR_FIBER_ASM_CONTEXT
+		if(shared_stack) {
+			//ڵһ롢󶨹ջ֮Ź
+			m_shared = true;
+			m_entry = use_caller ? &Fiber::CallerMainFunc : &Fiber::MainFunc;
+			SYLAR_LOG_DEBUG(g_logger) << " Fiber::Fiber id=" << m_id << " shared_stack";
+			return;
 		}
-		m_ctx.uc_link = nullptr; //ģǰִϺԶл
-		m_ctx.uc_stack.ss_sp = m_stack; //ָջַ
-		m_ctx.uc_stack.ss_size = m_stacksize; //ָջĴС
+#endif
+		m_stacksize = stacksize ? stacksize : g_fiber_stack_size->getValue();
 		
+		m_stack = AllocStack(m_stacksize, m_allocator);
+		SYLAR_ASSERT2(m_stack, "alloc fiber stack");
 		if(!use_caller) {
-			makecontext(&m_ctx, &Fiber::MainFunc, 0); //Ĺָ
+			MakeFiberContext(&m_ctx, m_stack, m_stacksize, &Fiber::MainFunc); //Ĺָ
 		}	
 		else {
-			makecontext(&m_ctx, &Fiber::CallerMainFunc, 0); //Ĺָ
+			MakeFiberContext(&m_ctx, m_stack, m_stacksize, &Fiber::CallerMainFunc);
 		}
 		SYLAR_LOG_DEBUG(g_logger) << " Fiber::Fiber id=" << m_id;
 	}
@@ -81,7 +305,13 @@ namespace sylar {
 			SYLAR_ASSERT(m_state == TERM
 			  || m_state == EXCEPT
 				|| m_state == INIT);
-			StackAllocator::Dealloc(m_stack, m_stacksize);
+			DeallocStack(m_allocator, m_stack, m_stacksize);
+		}
+		else if(m_shared) {
+			SYLAR_ASSERT(m_state == TERM
+			  || m_state == EXCEPT
+				|| m_state == INIT);
+			free(m_saveBuffer);
 		}
 		else {
 			SYLAR_ASSERT(!m_cb);
@@ -98,56 +328,135 @@ namespace sylar {
 	//Э̺״̬
 	//INIT,TERM
 	void Fiber::reset(std::function<void()> cb) {
-		SYLAR_ASSERT(m_stack);
+		SYLAR_ASSERT(m_stack || m_shared);
 		SYLAR_ASSERT(m_state == TERM
 		  || m_state == EXCEPT
 			|| m_state == INIT);
 		m_cb = cb;
-		if(getcontext(&m_ctx)) {
-			SYLAR_ASSERT2(false, "getcontext");
+		if(m_shared) {
+			//ʱѾ˹ջʱٰ
+			m_entry = &Fiber::MainFunc;
+			m_sharedStack = nullptr;
+		}
+		else {
+			MakeFiberContext(&m_ctx, m_stack, m_stacksize, &Fiber::MainFunc);
 		}
-		
-		m_ctx.uc_link = nullptr;
-		m_ctx.uc_stack.ss_sp = m_stack;
-		m_ctx.uc_stack.ss_size = m_stacksize;
-		
-		makecontext(&m_ctx, &Fiber::MainFunc, 0); //Ĺָ
 		m_state = INIT;
 	}
 	
 	void Fiber::call() {
+		if(m_shared) {
+			acquireSharedStack(true);
+		}
 		SetThis(this);
 		m_state = EXEC;
 		//SYLAR_LOG_ERROR(g_logger) << getId();
-		if(swapcontext(&t_threadFiber->m_ctx, &m_ctx)) {
-			SYLAR_ASSERT2(false, "swapcontext");
+		SwapFiberContext(&t_threadFiber->m_ctx, &m_ctx);
+		if(m_shared) {
+			releaseSharedStack();
 		}
 	}
 	
 	void Fiber::back() {
 	  SetThis(t_threadFiber.get());
-	  if(swapcontext(&m_ctx, &t_threadFiber->m_ctx)) {
-	  	SYLAR_ASSERT2(false, "swapcontext");
-	  }
+	  SwapFiberContext(&m_ctx, &t_threadFiber->m_ctx);
 	}
 	
 	//лǰЭִ
 	void Fiber::swapIn() {
+		SYLAR_ASSERT(m_state != EXEC);
+		if(m_shared) {
+			acquireSharedStack(true);
+		}
 		SetThis(this);
+		m_state = EXEC;
+		
+		SwapFiberContext(&Scheduler::GetMainFiber()->m_ctx, &m_ctx);
+		if(m_shared) {
+			releaseSharedStack();
+		}
+	}
+	
+	bool Fiber::trySwapIn() {
 		SYLAR_ASSERT(m_state != EXEC);
+		if(m_shared && !acquireSharedStack(false)) {
+			return false;
+		}
+		SetThis(this);
 		m_state = EXEC;
 		
-		if(swapcontext(&Scheduler::GetMainFiber()->m_ctx, &m_ctx)) {
-			SYLAR_ASSERT2(false, "swapcontext");
+		SwapFiberContext(&Scheduler::GetMainFiber()->m_ctx, &m_ctx);
+		if(m_shared) {
+			releaseSharedStack();
 		}
+		return true;
 	}
 	
 	//лִ̨
 	void Fiber::swapOut() {
 	  SetThis(Scheduler::GetMainFiber());
-	  if(swapcontext(&m_ctx, &Scheduler::GetMainFiber()->m_ctx)) {
-	  	SYLAR_ASSERT2(false, "swapcontext");
-	  }
+	  SwapFiberContext(&m_ctx, &Scheduler::GetMainFiber()->m_ctx);
+	}
+	
+	//лЭ̣˽ջϣջǻָ󶨵ͬһ鹲ջЭ̿߳ϻִָ
+	//öԷʽЭгʱֻͬһջҪЭʱŰռߵĻԾֿȥ
+	bool Fiber::acquireSharedStack(bool wait) {
+#ifdef SYLAR_FIBER_ASM_CONTEXT
+		if(!m_sharedStack) {
+			//ûջϣѡһеջ
+			SharedStackSet* stacks = m_sharedStacks ? m_sharedStacks : GetSharedStacks();
+			m_sharedStack = stacks->acquire(wait);
+			if(!m_sharedStack) {
+				return false;
+			}
+		}
+		else if(wait) {
+			m_sharedStack->mutex.lock();
+		}
+		else if(!m_sharedStack->mutex.tryLock()) {
+			return false;
+		}
+		SharedStack* ss = m_sharedStack;
+		if(ss->owner == this) {
+			return true;
+		}
+		char* top = ss->stack + ss->size;
+		if(ss->owner) {
+			//ռгʱջָ뵽ջȫԾݣļĴҲ
+			Fiber* owner = ss->owner;
+			char* sp = (char*)owner->m_ctx.sp;
+			uint32_t size = top - sp;
+			if(owner->m_saveCapacity < size || owner->m_saveCapacity > size * 2) {
+				free(owner->m_saveBuffer);
+				owner->m_saveBuffer = (char*)malloc(size);
+				SYLAR_ASSERT2(owner->m_saveBuffer, "alloc shared stack save buffer");
+				owner->m_saveCapacity = size;
+			}
+			memcpy(owner->m_saveBuffer, sp, size);
+			owner->m_saveSize = size;
+		}
+		ss->owner = this;
+		if(m_state == INIT) {
+			m_stacksize = ss->size;
+			MakeFiberContext(&m_ctx, ss->stack, ss->size, m_entry);
+		}
+		else {
+			memcpy(top - m_saveSize, m_saveBuffer, m_saveSize);
+		}
+#endif
+		return true;
+	}
+	
+	void Fiber::releaseSharedStack() {
+		SharedStack* ss = m_sharedStack;
+		if(m_state == TERM || m_state == EXCEPT) {
+			ss->owner = nullptr;
+			free(m_saveBuffer);
+			m_saveBuffer = nullptr;
+			m_saveSize = 0;
+			m_saveCapacity = 0;
+		}
+		ss->mutex.unlock();
 	}
 	
 	//صǰЭ
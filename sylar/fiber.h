@@ -4,10 +4,34 @@
 #include<memory>
 #include "thread.h"
 #include<functional>
-#include<ucontext.h>
+#include<vector>
+#include<atomic>
+#include "fiber_context.h"
 
 namespace sylar {
 class Scheduler;
+class StackAllocator;
+struct SharedStack;
+
+//һ鹲ջһʹʱ䣬ЭȰ󶨿еջ
+//ջģʽĵһ飬ڵдĹջЭʹý̹һ
+class SharedStackSet : Noncopyable {
+public:
+	//ջʹСڵһʹʱfiber.shared_stack_count/fiber.shared_stack_sizeȷ
+	SharedStackSet() {}
+	//ջϵĹЭ֮ٻִָУЭջͷ
+	~SharedStackSet();
+	//Ϊû󶨵ЭѡһջסwaitΪfalseջռʱnullptr
+	SharedStack* acquire(bool wait);
+private:
+	void init();
+private:
+	Mutex m_mutex;
+	std::atomic<bool> m_init = {false};
+	std::vector<SharedStack*> m_stacks;
+	std::atomic<size_t> m_next = {0};
+};
+
 class Fiber : public std::enable_shared_from_this<Fiber> { //̳˸࣬޷ջϽ,ڳԱͨ
 friend class Scheduler;                                    //shared_from_this()ȡǰָ	
 public:																								 
@@ -23,7 +47,9 @@ public:
 private:
 	Fiber();
 public:
-	Fiber(std::function<void()> cb, size_t stacksize = 0, bool user_caller = false);
+	//shared_stackΪtrueʱ˽ջڹջִУгԾְ追
+	//ֻлĺ֧֣ucontext˺Ըò
+	Fiber(std::function<void()> cb, size_t stacksize = 0, bool user_caller = false, bool shared_stack = false);
 	~Fiber();
 	
 	//Э̺״̬
@@ -37,6 +63,7 @@ public:
 	void back();
 	uint64_t getId() const {return m_id;}
 	State getState() const { return m_state;}
+	bool isSharedStack() const { return m_shared;}
 public:
 	//صǰЭ
 	static Fiber::ptr GetThis();
@@ -52,13 +79,32 @@ public:
 	static void MainFunc();
 	static void CallerMainFunc();
 	static uint64_t GetFiberId();
+private:
+	//лǰЭִУջ߳ϵЭռʱлfalseɵʹ
+	bool trySwapIn();
+	//빲ջЭ֮ǰãס󶨵Ĺջ浱ǰռߵĻԾջٻָЭ̵ջ
+	//waitΪfalseʱջѱռֱӷfalse
+	bool acquireSharedStack(bool wait);
+	//ջЭгãջִнʱͬʱռ
+	void releaseSharedStack();
 private:
 	uint64_t m_id = 0;
 	uint32_t m_stacksize = 0; //ջС
 	State m_state = INIT;
 	
-	ucontext_t m_ctx; //
+	FiberContext m_ctx; //
 	void* m_stack = nullptr; //ջռ
+	StackAllocator* m_allocator = nullptr; //ջռķ
+	
+	bool m_shared = false; //Ƿʹùջ
+	SharedStackSet* m_sharedStacks = nullptr; //ѡջջ飬Ϊʱʹý̹һ
+	SharedStack* m_sharedStack = nullptr; //ǰ󶨵Ĺջ
+	void (*m_entry)() = nullptr; //ջЭ̵ںһʱŹ
+	char* m_saveBuffer = nullptr; //г󱣴ĻԾջ
+	uint32_t m_saveSize = 0;
+	uint32_t m_saveCapacity = 0;
+	
+	bool m_pooled = false; //ɵΪص񴴽ԻյЭ̳
 	
 	std::function<void()> m_cb;
 };
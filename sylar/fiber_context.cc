@@ -0,0 +1,195 @@
+#include "fiber_context.h"
+#include "log.h"
+#include "macro.h"
+#include<stdint.h>
+
+#ifdef SYLAR_FIBER_ASM_CONTEXT
+
+extern "C" {
+	//保存callee-saved寄存器到当前栈，*from_sp = 当前栈指针，然后切换到to_sp并恢复寄存器
+	void sylar_swap_context(void** from_sp, void* to_sp);
+	//新上下文第一次切入时的入口，调用保存在callee-saved寄存器中的函数
+	void sylar_context_entry();
+}
+
+#if defined(__x86_64__)
+//栈布局(低地址->高地址)：fcw, mxcsr, r15, r14, r13, r12, rbx, rbp, 返回地址
+asm(R"(
+	.text
+	.globl sylar_swap_context
+	.hidden sylar_swap_context
+	.type sylar_swap_context, @function
+	.align 16
+sylar_swap_context:
+	.cfi_startproc
+	pushq %rbp
+	pushq %rbx
+	pushq %r12
+	pushq %r13
+	pushq %r14
+	pushq %r15
+	subq $16, %rsp
+	stmxcsr 8(%rsp)
+	fnstcw (%rsp)
+	movq %rsp, (%rdi)
+	movq %rsi, %rsp
+	ldmxcsr 8(%rsp)
+	fldcw (%rsp)
+	addq $16, %rsp
+	popq %r15
+	popq %r14
+	popq %r13
+	popq %r12
+	popq %rbx
+	popq %rbp
+	ret
+	.cfi_endproc
+	.size sylar_swap_context, .-sylar_swap_context
+
+	.globl sylar_context_entry
+	.hidden sylar_context_entry
+	.type sylar_context_entry, @function
+	.align 16
+sylar_context_entry:
+	.cfi_startproc
+	.cfi_undefined rip
+	xorl %ebp, %ebp
+	callq *%r12
+	ud2
+	.cfi_endproc
+	.size sylar_context_entry, .-sylar_context_entry
+)");
+
+namespace sylar {
+
+	static const size_t s_frame_size = 9;
+
+	void MakeFiberContext(FiberContext* ctx, void* stack, size_t size, void (*fn)()) {
+		uintptr_t top = ((uintptr_t)stack + size) & ~(uintptr_t)15;
+		//ret之后rsp = top - 16，按16字节对齐，满足入口函数call之前的对齐要求
+		void** sp = (void**)(top - 16 - s_frame_size * sizeof(void*));
+		sp[0] = (void*)0x037f;	//fcw默认值
+		sp[1] = (void*)0x1f80;	//mxcsr默认值
+		sp[2] = nullptr;				//r15
+		sp[3] = nullptr;				//r14
+		sp[4] = nullptr;				//r13
+		sp[5] = (void*)fn;			//r12
+		sp[6] = nullptr;				//rbx
+		sp[7] = nullptr;				//rbp
+		sp[8] = (void*)&sylar_context_entry;
+		ctx->sp = sp;
+	}
+
+}
+
+#elif defined(__aarch64__)
+//栈布局(低地址->高地址)：x19-x30, d8-d15
+asm(R"(
+	.text
+	.globl sylar_swap_context
+	.hidden sylar_swap_context
+	.type sylar_swap_context, %function
+	.align 4
+sylar_swap_context:
+	.cfi_startproc
+	sub sp, sp, #0xa0
+	stp x19, x20, [sp, #0x00]
+	stp x21, x22, [sp, #0x10]
+	stp x23, x24, [sp, #0x20]
+	stp x25, x26, [sp, #0x30]
+	stp x27, x28, [sp, #0x40]
+	stp x29, x30, [sp, #0x50]
+	stp d8, d9, [sp, #0x60]
+	stp d10, d11, [sp, #0x70]
+	stp d12, d13, [sp, #0x80]
+	stp d14, d15, [sp, #0x90]
+	mov x9, sp
+	str x9, [x0]
+	mov sp, x1
+	ldp x19, x20, [sp, #0x00]
+	ldp x21, x22, [sp, #0x10]
+	ldp x23, x24, [sp, #0x20]
+	ldp x25, x26, [sp, #0x30]
+	ldp x27, x28, [sp, #0x40]
+	ldp x29, x30, [sp, #0x50]
+	ldp d8, d9, [sp, #0x60]
+	ldp d10, d11, [sp, #0x70]
+	ldp d12, d13, [sp, #0x80]
+	ldp d14, d15, [sp, #0x90]
+	add sp, sp, #0xa0
+	ret
+	.cfi_endproc
+	.size sylar_swap_context, .-sylar_swap_context
+
+	.globl sylar_context_entry
+	.hidden sylar_context_entry
+	.type sylar_context_entry, %function
+	.align 4
+sylar_context_entry:
+	.cfi_startproc
+	.cfi_undefined x30
+	mov x29, #0
+	blr x19
+	brk #0
+	.cfi_endproc
+	.size sylar_context_entry, .-sylar_context_entry
+)");
+
+namespace sylar {
+
+	static const size_t s_frame_size = 20;
+
+	void MakeFiberContext(FiberContext* ctx, void* stack, size_t size, void (*fn)()) {
+		uintptr_t top = ((uintptr_t)stack + size) & ~(uintptr_t)15;
+		void** sp = (void**)(top - s_frame_size * sizeof(void*));
+		for(size_t i = 0; i < s_frame_size; ++i) {
+			sp[i] = nullptr;
+		}
+		sp[0] = (void*)fn;													//x19
+		sp[11] = (void*)&sylar_context_entry;				//x30
+		ctx->sp = sp;
+	}
+
+}
+
+#endif
+
+namespace sylar {
+
+	void SwapFiberContext(FiberContext* from, FiberContext* to) {
+		sylar_swap_context(&from->sp, to->sp);
+	}
+
+	const char* FiberContextBackend() {
+		return "asm";
+	}
+
+}
+
+#else
+
+namespace sylar {
+
+	void MakeFiberContext(FiberContext* ctx, void* stack, size_t size, void (*fn)()) {
+		if(getcontext(&ctx->ctx)) {
+			SYLAR_ASSERT2(false, "getcontext");
+		}
+		ctx->ctx.uc_link = nullptr;
+		ctx->ctx.uc_stack.ss_sp = stack;
+		ctx->ctx.uc_stack.ss_size = size;
+		makecontext(&ctx->ctx, fn, 0);
+	}
+
+	void SwapFiberContext(FiberContext* from, FiberContext* to) {
+		if(swapcontext(&from->ctx, &to->ctx)) {
+			SYLAR_ASSERT2(false, "swapcontext");
+		}
+	}
+
+	const char* FiberContextBackend() {
+		return "ucontext";
+	}
+
+}
+
+#endif
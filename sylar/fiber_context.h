@@ -0,0 +1,37 @@
+#ifndef __SYLAR_FIBER_CONTEXT_H__
+#define __SYLAR_FIBER_CONTEXT_H__
+
+#include<stddef.h>
+
+//协程上下文切换后端，编译期选择
+//x86_64和aarch64默认使用汇编实现，只保存callee-saved寄存器和栈指针，切换过程没有系统调用
+//定义SYLAR_FIBER_UCONTEXT（cmake -DSYLAR_FIBER_CONTEXT=ucontext）或其他架构时使用ucontext
+//注意：汇编后端不保存信号掩码，协程内修改的信号掩码会影响整个线程
+#if !defined(SYLAR_FIBER_UCONTEXT) && (defined(__x86_64__) || defined(__aarch64__))
+#	define SYLAR_FIBER_ASM_CONTEXT 1
+#else
+#	include<ucontext.h>
+#endif
+
+namespace sylar {
+
+struct FiberContext {
+#ifdef SYLAR_FIBER_ASM_CONTEXT
+	void* sp = nullptr;		//切出时的栈指针，寄存器保存在栈上
+#else
+	ucontext_t ctx;
+#endif
+};
+
+//初始化上下文，切入后在[stack, stack + size)上执行fn，fn不能返回
+void MakeFiberContext(FiberContext* ctx, void* stack, size_t size, void (*fn)());
+
+//保存当前上下文到from，并切换到to
+void SwapFiberContext(FiberContext* from, FiberContext* to);
+
+//当前编译使用的后端名称，asm或ucontext
+const char* FiberContextBackend();
+
+}
+
+#endif
@@ -7,6 +7,7 @@
 #include "iomanager.h"
 #include "fd_manager.h"
 #include "macro.h"
+#include "io_uring.h"
 
 
 sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
@@ -77,15 +78,28 @@ namespace sylar {
 	}
 }
 
-struct timer_info{
-		int cancelled = 0;
-	};
+//Эг߳ϻָ__errno_locationconstгǰȡõerrnoַ
+//дԭ̵߳errnoгĴͨдerrnoÿȡǰ̵߳ĵַ
+static __attribute__((noinline)) int get_errno() {
+	return errno;
+}
+
+static __attribute__((noinline)) void set_errno(int v) {
+	errno = v;
+}
+
+//֧io_uringĲ
+struct no_uring_prep {
+	bool operator()(io_uring_sqe& sqe) const { return false;}
+};
 
 //HOOKsocketIO¼δHOOKִԭHOOK
 	//ظִsocketIOֱֳʱ
-	template<typename OriginFun, typename ... Args>
+	//prepȼ۵io_uringIOManagerio_uringʱԴݲúֱύ
+	//һύɵȴͶдaddEventepoll_wait֮
+	template<typename OriginFun, typename UringPrep, typename ... Args>
 	static ssize_t do_io(int fd, OriginFun fun, const char* hook_fun_name,
-			uint32_t event, int timeout_so, Args&&... args) {
+			uint32_t event, int timeout_so, UringPrep prep, Args&&... args) {
 		if(!sylar::t_hook_enable) {
 			return fun(fd, std::forward<Args>(args)...);
 		}	
@@ -106,48 +120,48 @@ struct timer_info{
 		}
 		
 		uint64_t to = ctx->getTimeout(timeout_so);
-		std::shared_ptr<timer_info> tinfo(new timer_info);
 retry:			
 		ssize_t n = fun(fd, std::forward<Args>(args)...);
-		while(n == -1 && errno == EINTR) {  //ϵͳñźж
+		while(n == -1 && get_errno() == EINTR) {  //ϵͳñźж
 			n = fun(fd, std::forward<Args>(args)...);
 		}
-		if(n == -1 && errno == EAGAIN) { //ǰԴݲ
+		if(n == -1 && get_errno() == EAGAIN) { //ǰԴݲ
 			sylar::IOManager* iom = sylar::IOManager::GetThis();
-			sylar::Timer::ptr timer;
-			std::weak_ptr<timer_info> winfo(tinfo);
-				
-			if(to != (uint64_t)-1) {
-				timer = iom->addConditionTimer(to, [winfo, fd, iom, event]() {
-					auto t = winfo.lock(); //.lock()һshared_ptr
-					if(!t || t->cancelled) {
-						return;
+			if(iom->hasIoUring()) {
+				io_uring_sqe sqe;
+				int res = 0;
+				//ںûеȴֱӷ-EAGAINʱepollȴ
+				if(prep(sqe) && iom->submitIo(sqe, to, res) && res != -EAGAIN) {
+					//closeʱȡ
+					if(res == -ECANCELED) {
+						res = -EBADF;
 					}
-					t->cancelled = ETIMEDOUT;
-					//1
-					iom->cancelEvent(fd, (sylar::IOManager::Event)(event));
-				}, winfo);
+					if(res < 0) {
+						set_errno(-res);
+						return -1;
+					}
+					return res;
+				}
+			}
+			//1 ע¼ͬʱϳʱʱʱڵIOManagerfdУڴ
+			uint32_t seq = 0;
+			int rt = iom->waitEvent(fd, (sylar::IOManager::Event)(event), to, seq);
+			if(rt == 1) {
+				//־עģʽ֮ǰѾֱ
+				goto retry;
 			}
-			//2
-			int rt = iom->addEvent(fd, (sylar::IOManager::Event)(event));
-			if(rt) {
+			else if(rt) {
 					SYLAR_LOG_ERROR(g_logger) << hook_fun_name << " addEvent("
 							<< fd << ", " << event << ")";
-			  if(timer) {
-			  	timer->cancel();
-			  }
 			  return -1;
 			}
 			else {
-				//1. cancelEventʱӴ˴
+				//2 ʱcancelEventʱҲӴ˴
 				//SYLAR_LOG_DEBUG(g_logger) << "do_io" << hook_fun_name << ">";
 				sylar::Fiber::YieldToHold();
 			 // SYLAR_LOG_DEBUG(g_logger) << "do_io" << hook_fun_name << ">";
-				if(timer) {
-					timer->cancel();
-				}
-				if(tinfo->cancelled) {
-					errno = tinfo->cancelled;
+				if(iom->finishWait(fd, (sylar::IOManager::Event)(event), seq)) {
+					set_errno(ETIMEDOUT);
 					return -1;
 				}
 				
@@ -233,43 +247,49 @@ extern "C" {
   		return connect_f(fd, addr, addrlen);
   	}
   	
-  	int n = connect_f(fd, addr, addrlen);
-  	if(n == 0) {
-  		return 0;
+  	sylar::IOManager* iom = sylar::IOManager::GetThis();
+  	//io_uringֱύconnectʱѽʧ
+  	int res = 0;
+  	if(iom->hasIoUring()) {
+  		io_uring_sqe sqe;
+  		sylar::IoUring::PrepConnect(sqe, fd, addr, addrlen);
+  		//socketǷģں˿ܲɾͷ-EAGAIN-EINPROGRESSdo_ioһepollȴ
+  		if(iom->submitIo(sqe, timeout_ms, res) && res != -EAGAIN && res != -EINPROGRESS) {
+  			if(res == -ECANCELED) {
+  				res = -EBADF;
+  			}
+  			if(res < 0) {
+  				set_errno(-res);
+  				return -1;
+  			}
+  			return 0;
+  		}
   	}
-  	else if(n != -1 || errno != EINPROGRESS) { //EINPROGRESSʾڽ
-  		return n;
+  	
+  	//-EINPROGRESSʱѾٴconnectֻõEALREADYֱӵȴд
+  	if(res != -EINPROGRESS) {
+  		int n = connect_f(fd, addr, addrlen);
+  		if(n == 0) {
+  			return 0;
+  		}
+  		else if(n != -1 || errno != EINPROGRESS) { //EINPROGRESSʾڽ
+  			return n;
+  		}
   	}
   	
-  	sylar::IOManager* iom = sylar::IOManager::GetThis();
-  	sylar::Timer::ptr timer;
-  	std::shared_ptr<timer_info> tinfo(new timer_info);
-  	std::weak_ptr<timer_info> winfo(tinfo);
-  	if(timeout_ms !=(uint64_t)-1) {
-  		timer = iom->addConditionTimer(timeout_ms, [winfo, fd, iom]() {
-  			auto t = winfo.lock();
-  			if(!t || t->cancelled) {
-  				return;
-  			}
-  			t->cancelled = ETIMEDOUT;
-  			iom->cancelEvent(fd, sylar::IOManager::WRITE);
-  		}, winfo);
+  	uint32_t seq = 0;
+  	int rt = iom->waitEvent(fd, sylar::IOManager::WRITE, timeout_ms, seq);
+  	if(rt == 1) {
+  		//־עģʽѾдֱӼӽ
   	}
-  	int rt = iom->addEvent(fd, sylar::IOManager::WRITE);
-  	if(rt == 0) {
+  	else if(rt == 0) {
   		sylar::Fiber::YieldToHold();
-  		if(timer) {
-  			timer->cancel();
-  		}
-  		if(tinfo->cancelled) {
-  			errno = tinfo->cancelled;
+  		if(iom->finishWait(fd, sylar::IOManager::WRITE, seq)) {
+  			set_errno(ETIMEDOUT);
   			return -1;
   		}
   	}
   	else {
-  		if(timer) {
-  			timer->cancel();
-  		}
   		SYLAR_LOG_ERROR(g_logger) << "connect addEvent(" << fd << ", WRITE) error";
   	}
   	
@@ -282,7 +302,7 @@ extern "C" {
   		return 0;
   	}
   	else {
-  		errno = error;
+  		set_errno(error);
   		return -1;
   	}
   } 
@@ -294,7 +314,9 @@ extern "C" {
 	
 	//ܿͻ˵󣬲һ׽ͨ
 	int accept(int s, struct sockaddr *addr, socklen_t *addrlen) {
-		int fd = do_io(s, accept_f, "accept", sylar::IOManager::READ, SO_RCVTIMEO, addr, addrlen);
+		int fd = do_io(s, accept_f, "accept", sylar::IOManager::READ, SO_RCVTIMEO
+				, [=](io_uring_sqe& sqe){ sylar::IoUring::PrepAccept(sqe, s, addr, addrlen, 0); return true;}
+				, addr, addrlen);
 		if(fd >= 0) {
 			sylar::FdMgr::GetInstance()->get(fd, true);
 		}
@@ -302,47 +324,55 @@ extern "C" {
 	}
 	
 	ssize_t read(int fd, void *buf, size_t count) {
-		return do_io(fd, read_f, "read", sylar::IOManager::READ, SO_RCVTIMEO, buf, count);
+		return do_io(fd, read_f, "read", sylar::IOManager::READ, SO_RCVTIMEO
+				, [=](io_uring_sqe& sqe){ sylar::IoUring::PrepRead(sqe, fd, buf, count); return true;}
+				, buf, count);
 	}
 	
 	ssize_t readv(int fd, const struct iovec *iov, int iovcnt) {
-		return do_io(fd, readv_f, "readv", sylar::IOManager::READ, SO_RCVTIMEO, iov, iovcnt);
+		return do_io(fd, readv_f, "readv", sylar::IOManager::READ, SO_RCVTIMEO, no_uring_prep(), iov, iovcnt);
 	}
 	
   ssize_t recv(int sockfd, void *buf, size_t len, int flags) {
-  	return do_io(sockfd, recv_f, "recv", sylar::IOManager::READ, SO_RCVTIMEO, buf, len, flags);
+  	return do_io(sockfd, recv_f, "recv", sylar::IOManager::READ, SO_RCVTIMEO
+  			, [=](io_uring_sqe& sqe){ sylar::IoUring::PrepRecv(sqe, sockfd, buf, len, flags); return true;}
+  			, buf, len, flags);
   }
 	
 	ssize_t recvfrom(int sockfd, void *buf, size_t len, int flags, struct sockaddr *src_addr, socklen_t *addrlen) {
-		return do_io(sockfd, recvfrom_f, "recvfrom", sylar::IOManager::READ, SO_RCVTIMEO, buf, len, flags, src_addr, addrlen);	
+		return do_io(sockfd, recvfrom_f, "recvfrom", sylar::IOManager::READ, SO_RCVTIMEO, no_uring_prep(), buf, len, flags, src_addr, addrlen);	
 	}
 	
 	ssize_t recvmsg(int sockfd, struct msghdr *msg, int flags) {
-		return do_io(sockfd, recvmsg_f, "recvmsg", sylar::IOManager::READ, SO_RCVTIMEO, msg, flags);
+		return do_io(sockfd, recvmsg_f, "recvmsg", sylar::IOManager::READ, SO_RCVTIMEO, no_uring_prep(), msg, flags);
 	}
 	
 	ssize_t write(int fd, const void *buf, size_t count) {
-		return do_io(fd, write_f, "write", sylar::IOManager::WRITE, SO_SNDTIMEO, buf, count);
+		return do_io(fd, write_f, "write", sylar::IOManager::WRITE, SO_SNDTIMEO
+				, [=](io_uring_sqe& sqe){ sylar::IoUring::PrepWrite(sqe, fd, buf, count); return true;}
+				, buf, count);
 	}
   
   ssize_t writev(int fd, const struct iovec *iov, int iovcnt) {
-  	return do_io(fd, writev_f, "writev", sylar::IOManager::WRITE, SO_SNDTIMEO, iov, iovcnt);
+  	return do_io(fd, writev_f, "writev", sylar::IOManager::WRITE, SO_SNDTIMEO, no_uring_prep(), iov, iovcnt);
   }
   
   ssize_t send(int s, const void *msg, size_t len, int flags) {
-  	return do_io(s, send_f, "send", sylar::IOManager::WRITE, SO_SNDTIMEO, msg, len, flags);
+  	return do_io(s, send_f, "send", sylar::IOManager::WRITE, SO_SNDTIMEO
+  			, [=](io_uring_sqe& sqe){ sylar::IoUring::PrepSend(sqe, s, msg, len, flags); return true;}
+  			, msg, len, flags);
   }
 
   ssize_t sendto(int s, const void *msg, size_t len, int flags, const struct sockaddr *to, socklen_t tolen) {
-  	return do_io(s, sendto_f, "sendto", sylar::IOManager::WRITE, SO_SNDTIMEO, msg, len, flags, to, tolen);
+  	return do_io(s, sendto_f, "sendto", sylar::IOManager::WRITE, SO_SNDTIMEO, no_uring_prep(), msg, len, flags, to, tolen);
   }
   
   ssize_t sendmsg(int s, const struct msghdr *msg, int flags) {
-  	return do_io(s, sendmsg_f, "sendmsg", sylar::IOManager::WRITE, SO_SNDTIMEO, msg, flags);
+  	return do_io(s, sendmsg_f, "sendmsg", sylar::IOManager::WRITE, SO_SNDTIMEO, no_uring_prep(), msg, flags);
   }
 
   int close(int fd) {
-  	if(sylar::t_hook_enable) {
+  	if(!sylar::t_hook_enable) {
   		return close_f(fd);
   	}
   	sylar::FdCtx::ptr ctx = sylar::FdMgr::GetInstance()->get(fd);
@@ -350,6 +380,7 @@ extern "C" {
   		auto iom = sylar::IOManager::GetThis();
   		if(iom) {
   			iom->cancelAll(fd);
+  			iom->cancelIo(fd);
   		}
   		sylar::FdMgr::GetInstance()->del(fd);
   	}
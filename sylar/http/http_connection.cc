@@ -17,7 +17,8 @@ namespace http {
 	static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
 	
 	HttpConnection::HttpConnection(Socket::ptr sock, bool owner)
-			:SocketStream(sock, owner) {
+			:SocketStream(sock, owner)
+			,m_createTime(sylar::GetCoarseMonotonicMS()) {
 	}
 	
 	HttpConnection::~HttpConnection() {
@@ -273,7 +274,7 @@ namespace http {
 	}
 					
 	HttpConnection::ptr HttpConnectionPool::getConnection() {
-		uint64_t now_ms = sylar::GetCurrentMS();
+		uint64_t now_ms = sylar::GetCoarseMonotonicMS();
 		std::vector<HttpConnection*> invalid_conns;
 		HttpConnection* ptr = nullptr;
 		MutexType::Lock lock(m_mutex);
@@ -284,7 +285,7 @@ namespace http {
 				invalid_conns.push_back(conn);
 				continue;
 			}
-			if(conn->m_createTime + m_maxAliveTime > now_ms) {
+			if(conn->m_createTime + m_maxAliveTime <= now_ms) {
 				invalid_conns.push_back(conn);
 				continue;
 			}
@@ -321,7 +322,7 @@ namespace http {
 	
 	void HttpConnectionPool::ReleasePtr(HttpConnection* ptr, HttpConnectionPool* pool) {
 		++ptr->m_request;
-		if((!ptr->isConnected()) || (ptr->m_createTime + pool->m_maxAliveTime >= sylar::GetCurrentMS())
+		if((!ptr->isConnected()) || (ptr->m_createTime + pool->m_maxAliveTime <= sylar::GetCoarseMonotonicMS())
 					|| ptr->m_request >= pool->m_maxRequest) {
 			delete ptr;
 			--pool->m_total;
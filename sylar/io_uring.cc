@@ -0,0 +1,294 @@
+#include "io_uring.h"
+#include "log.h"
+#include "macro.h"
+#include<unistd.h>
+#include<errno.h>
+#include<string.h>
+#include<stdlib.h>
+#include<sys/mman.h>
+#include<sys/syscall.h>
+#include<sys/eventfd.h>
+
+namespace sylar {
+
+	static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+	//hook需要的操作码，缺少任何一个都不启用
+	static const uint8_t s_required_ops[] = {
+		IORING_OP_READ,
+		IORING_OP_WRITE,
+		IORING_OP_RECV,
+		IORING_OP_SEND,
+		IORING_OP_ACCEPT,
+		IORING_OP_CONNECT,
+		IORING_OP_ASYNC_CANCEL,
+	};
+
+	IoUring::IoUring() {
+	}
+
+	IoUring::~IoUring() {
+		destroy();
+	}
+
+	void IoUring::destroy() {
+		if(m_sqes) {
+			munmap(m_sqes, m_sqesSize);
+			m_sqes = nullptr;
+		}
+		if(m_cqRing && m_cqRing != m_sqRing) {
+			munmap(m_cqRing, m_cqRingSize);
+		}
+		m_cqRing = nullptr;
+		if(m_sqRing) {
+			munmap(m_sqRing, m_sqRingSize);
+			m_sqRing = nullptr;
+		}
+		if(m_ringFd >= 0) {
+			close(m_ringFd);
+			m_ringFd = -1;
+		}
+		if(m_eventFd >= 0) {
+			close(m_eventFd);
+			m_eventFd = -1;
+		}
+	}
+
+	bool IoUring::init(uint32_t entries) {
+		io_uring_params params;
+		memset(&params, 0, sizeof(params));
+		//完成队列比提交队列长，在途请求数以完成队列长度为上限
+		params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+		params.cq_entries = entries * 4;
+		m_ringFd = syscall(__NR_io_uring_setup, entries, &params);
+		if(m_ringFd < 0) {
+			SYLAR_LOG_WARN(g_logger) << "io_uring_setup(" << entries << ") errno=" << errno
+				<< " errstr=" << strerror(errno);
+			return false;
+		}
+
+		//没有FAST_POLL的内核对非阻塞socket的recv/send/accept直接以-EAGAIN完成，不会等待就绪
+		if(!(params.features & IORING_FEAT_FAST_POLL)) {
+			SYLAR_LOG_WARN(g_logger) << "io_uring IORING_FEAT_FAST_POLL not supported";
+			destroy();
+			return false;
+		}
+
+		size_t probe_size = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+		io_uring_probe* probe = (io_uring_probe*)calloc(1, probe_size);
+		int rt = syscall(__NR_io_uring_register, m_ringFd, IORING_REGISTER_PROBE, probe, 256);
+		bool supported = rt == 0;
+		for(size_t i = 0; supported && i < sizeof(s_required_ops); ++i) {
+			uint8_t op = s_required_ops[i];
+			supported = op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+			if(!supported) {
+				SYLAR_LOG_WARN(g_logger) << "io_uring op " << (int)op << " not supported";
+			}
+		}
+		free(probe);
+		if(!supported) {
+			destroy();
+			return false;
+		}
+
+		m_sqEntries = params.sq_entries;
+		m_cqEntries = params.cq_entries;
+		m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+		if(single_mmap && m_cqRingSize > m_sqRingSize) {
+			m_sqRingSize = m_cqRingSize;
+		}
+		m_sqRing = mmap(0, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE
+				, m_ringFd, IORING_OFF_SQ_RING);
+		if(m_sqRing == MAP_FAILED) {
+			m_sqRing = nullptr;
+			SYLAR_LOG_WARN(g_logger) << "io_uring mmap sq ring errno=" << errno;
+			destroy();
+			return false;
+		}
+		if(single_mmap) {
+			m_cqRing = m_sqRing;
+		}
+		else {
+			m_cqRing = mmap(0, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE
+					, m_ringFd, IORING_OFF_CQ_RING);
+			if(m_cqRing == MAP_FAILED) {
+				m_cqRing = nullptr;
+				SYLAR_LOG_WARN(g_logger) << "io_uring mmap cq ring errno=" << errno;
+				destroy();
+				return false;
+			}
+		}
+		m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+		m_sqes = (io_uring_sqe*)mmap(0, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE
+				, m_ringFd, IORING_OFF_SQES);
+		if(m_sqes == MAP_FAILED) {
+			m_sqes = nullptr;
+			SYLAR_LOG_WARN(g_logger) << "io_uring mmap sqes errno=" << errno;
+			destroy();
+			return false;
+		}
+
+		char* sq = (char*)m_sqRing;
+		m_sqHead = (unsigned*)(sq + params.sq_off.head);
+		m_sqTail = (unsigned*)(sq + params.sq_off.tail);
+		m_sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+		m_sqArray = (unsigned*)(sq + params.sq_off.array);
+		char* cq = (char*)m_cqRing;
+		m_cqHead = (unsigned*)(cq + params.cq_off.head);
+		m_cqTail = (unsigned*)(cq + params.cq_off.tail);
+		m_cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+		m_cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+
+		m_eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		SYLAR_ASSERT(m_eventFd >= 0);
+		rt = syscall(__NR_io_uring_register, m_ringFd, IORING_REGISTER_EVENTFD, &m_eventFd, 1);
+		if(rt) {
+			SYLAR_LOG_WARN(g_logger) << "io_uring register eventfd errno=" << errno
+				<< " errstr=" << strerror(errno);
+			destroy();
+			return false;
+		}
+		return true;
+	}
+
+	bool IoUring::enter(io_uring_sqe& sqe, uint64_t user_data) {
+		Mutex::Lock lock(m_submitMutex);
+		//取消请求不受限制，保证超时和关闭总能取消在途请求，多出的完成事件由内核暂存
+		if(user_data && m_inflight >= m_cqEntries) {
+			return false;
+		}
+		//只有本对象写入队尾，内核在io_uring_enter中取走后推进队首
+		unsigned tail = *m_sqTail;
+		unsigned head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+		if(tail - head >= m_sqEntries) {
+			return false;
+		}
+		unsigned index = tail & *m_sqMask;
+		m_sqes[index] = sqe;
+		m_sqes[index].user_data = user_data;
+		m_sqArray[index] = index;
+		__atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+		++m_inflight;
+
+		int rt = 0;
+		do {
+			rt = syscall(__NR_io_uring_enter, m_ringFd, 1, 0, 0, nullptr, 0);
+		} while(rt < 0 && errno == EINTR);
+		//内核没有取走时撤回，避免之后带着失效的user_data被提交
+		if(rt <= 0 && __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) == tail) {
+			SYLAR_LOG_WARN(g_logger) << "io_uring_enter rt=" << rt << " errno=" << errno
+				<< " errstr=" << strerror(errno);
+			__atomic_store_n(m_sqTail, tail, __ATOMIC_RELEASE);
+			--m_inflight;
+			return false;
+		}
+		return true;
+	}
+
+	bool IoUring::submit(const io_uring_sqe& sqe, uint64_t user_data) {
+		//user_data为0的完成事件保留给取消请求
+		SYLAR_ASSERT(user_data != 0);
+		io_uring_sqe tmp = sqe;
+		return enter(tmp, user_data);
+	}
+
+	bool IoUring::cancel(uint64_t user_data) {
+		io_uring_sqe sqe;
+		memset(&sqe, 0, sizeof(sqe));
+		sqe.opcode = IORING_OP_ASYNC_CANCEL;
+		sqe.fd = -1;
+		sqe.addr = user_data;
+		return enter(sqe, 0);
+	}
+
+	bool IoUring::cancelFd(int fd) {
+		io_uring_sqe sqe;
+		memset(&sqe, 0, sizeof(sqe));
+		sqe.opcode = IORING_OP_ASYNC_CANCEL;
+		sqe.fd = fd;
+		sqe.cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+		return enter(sqe, 0);
+	}
+
+	size_t IoUring::reap(io_uring_cqe* cqes, size_t max) {
+		Spinlock::Lock lock(m_reapMutex);
+		unsigned head = *m_cqHead;
+		unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+		size_t n = 0;
+		while(head != tail && n < max) {
+			io_uring_cqe& cqe = m_cqes[head & *m_cqMask];
+			++head;
+			--m_inflight;
+			if(cqe.user_data == 0) {
+				continue;
+			}
+			cqes[n].user_data = cqe.user_data;
+			cqes[n].res = cqe.res;
+			cqes[n].flags = cqe.flags;
+			++n;
+		}
+		__atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+		return n;
+	}
+
+	bool IoUring::hasCompletions() const {
+		return __atomic_load_n(m_cqHead, __ATOMIC_RELAXED)
+			!= __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+	}
+
+	void IoUring::PrepRead(io_uring_sqe& sqe, int fd, void* buf, size_t len) {
+		memset(&sqe, 0, sizeof(sqe));
+		sqe.opcode = IORING_OP_READ;
+		sqe.fd = fd;
+		sqe.addr = (uint64_t)buf;
+		sqe.len = len;
+		sqe.off = (uint64_t)-1;		//使用并推进当前文件位置
+	}
+
+	void IoUring::PrepWrite(io_uring_sqe& sqe, int fd, const void* buf, size_t len) {
+		memset(&sqe, 0, sizeof(sqe));
+		sqe.opcode = IORING_OP_WRITE;
+		sqe.fd = fd;
+		sqe.addr = (uint64_t)buf;
+		sqe.len = len;
+		sqe.off = (uint64_t)-1;
+	}
+
+	void IoUring::PrepRecv(io_uring_sqe& sqe, int fd, void* buf, size_t len, int flags) {
+		memset(&sqe, 0, sizeof(sqe));
+		sqe.opcode = IORING_OP_RECV;
+		sqe.fd = fd;
+		sqe.addr = (uint64_t)buf;
+		sqe.len = len;
+		sqe.msg_flags = flags;
+	}
+
+	void IoUring::PrepSend(io_uring_sqe& sqe, int fd, const void* buf, size_t len, int flags) {
+		memset(&sqe, 0, sizeof(sqe));
+		sqe.opcode = IORING_OP_SEND;
+		sqe.fd = fd;
+		sqe.addr = (uint64_t)buf;
+		sqe.len = len;
+		sqe.msg_flags = flags;
+	}
+
+	void IoUring::PrepAccept(io_uring_sqe& sqe, int fd, sockaddr* addr, socklen_t* addrlen, int flags) {
+		memset(&sqe, 0, sizeof(sqe));
+		sqe.opcode = IORING_OP_ACCEPT;
+		sqe.fd = fd;
+		sqe.addr = (uint64_t)addr;
+		sqe.addr2 = (uint64_t)addrlen;
+		sqe.accept_flags = flags;
+	}
+
+	void IoUring::PrepConnect(io_uring_sqe& sqe, int fd, const sockaddr* addr, socklen_t addrlen) {
+		memset(&sqe, 0, sizeof(sqe));
+		sqe.opcode = IORING_OP_CONNECT;
+		sqe.fd = fd;
+		sqe.addr = (uint64_t)addr;
+		sqe.off = addrlen;
+	}
+
+}
@@ -0,0 +1,80 @@
+#ifndef __SYLAR_IO_URING_H__
+#define __SYLAR_IO_URING_H__
+
+#include<memory>
+#include<stdint.h>
+#include<sys/socket.h>
+#include<linux/io_uring.h>
+#include "thread.h"
+#include "noncopyable.h"
+
+namespace sylar {
+
+	//io_uring的最小封装，直接使用系统调用，不依赖liburing
+	//多个线程可以同时提交（内部加锁），完成事件通过注册的eventfd通知，由reap()批量取出
+	class IoUring : Noncopyable {
+	public:
+		typedef std::shared_ptr<IoUring> ptr;
+
+		IoUring();
+		~IoUring();
+
+		//创建entries长度的提交队列、注册完成通知eventfd并检查需要的操作码
+		//内核不支持io_uring、被禁用、没有IORING_FEAT_FAST_POLL或者缺少需要的操作时返回false
+		bool init(uint32_t entries);
+
+		//提交一个请求，完成时reap()返回同样的user_data
+		//同时在途的请求数达到完成队列长度或者系统调用失败时返回false，请求没有进入内核
+		bool submit(const io_uring_sqe& sqe, uint64_t user_data);
+		//取消user_data对应的请求，被取消的请求以-ECANCELED完成
+		bool cancel(uint64_t user_data);
+		//取消fd上所有在途请求（内核5.19以上）
+		bool cancelFd(int fd);
+
+		//取出最多max个完成事件，返回取出的数量，取消请求本身的完成事件不返回
+		size_t reap(io_uring_cqe* cqes, size_t max);
+		//完成队列中是否有未取出的事件，只读共享内存，不产生系统调用
+		bool hasCompletions() const;
+
+		//有新完成事件时可读的eventfd
+		int getEventFd() const { return m_eventFd;}
+
+		static void PrepRead(io_uring_sqe& sqe, int fd, void* buf, size_t len);
+		static void PrepWrite(io_uring_sqe& sqe, int fd, const void* buf, size_t len);
+		static void PrepRecv(io_uring_sqe& sqe, int fd, void* buf, size_t len, int flags);
+		static void PrepSend(io_uring_sqe& sqe, int fd, const void* buf, size_t len, int flags);
+		static void PrepAccept(io_uring_sqe& sqe, int fd, sockaddr* addr, socklen_t* addrlen, int flags);
+		static void PrepConnect(io_uring_sqe& sqe, int fd, const sockaddr* addr, socklen_t addrlen);
+	private:
+		bool enter(io_uring_sqe& sqe, uint64_t user_data);
+		void destroy();
+	private:
+		int m_ringFd = -1;
+		int m_eventFd = -1;
+		//提交队列
+		void* m_sqRing = nullptr;
+		size_t m_sqRingSize = 0;
+		io_uring_sqe* m_sqes = nullptr;
+		size_t m_sqesSize = 0;
+		unsigned* m_sqHead = nullptr;
+		unsigned* m_sqTail = nullptr;
+		unsigned* m_sqMask = nullptr;
+		unsigned* m_sqArray = nullptr;
+		unsigned m_sqEntries = 0;
+		//完成队列，内核支持时与提交队列共用一次mmap
+		void* m_cqRing = nullptr;
+		size_t m_cqRingSize = 0;
+		unsigned* m_cqHead = nullptr;
+		unsigned* m_cqTail = nullptr;
+		unsigned* m_cqMask = nullptr;
+		io_uring_cqe* m_cqes = nullptr;
+		unsigned m_cqEntries = 0;
+		//已提交但完成事件还没有取出的请求数，不超过完成队列长度，完成队列就不会溢出
+		std::atomic<unsigned> m_inflight = {0};
+		Mutex m_submitMutex;		//提交时持有期间有系统调用，使用互斥锁
+		Spinlock m_reapMutex;
+	};
+
+}
+
+#endif
@@ -1,15 +1,82 @@
 #include "iomanager.h"
 #include "macro.h"
+#include "io_uring.h"
+#include "config.h"
 #include<unistd.h>
 #include<sys/epoll.h>
 #include "log.h"
 #include<fcntl.h>
 #include<errno.h>
 #include<string.h>
+#include<sys/eventfd.h>
+#include<sys/resource.h>
 
 namespace sylar {
 	
 	static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+	
+	static ConfigVar<std::string>::ptr g_iomanager_backend =
+		Config::Lookup<std::string>("iomanager.backend", "epoll", "iomanager reactor backend: epoll or io_uring");
+	static ConfigVar<bool>::ptr g_iomanager_persistent_registration =
+		Config::Lookup<bool>("iomanager.persistent_registration", false
+			, "keep sockets registered in epoll with EPOLLIN|EPOLLOUT|EPOLLET until close");
+	static ConfigVar<uint32_t>::ptr g_iomanager_io_uring_entries =
+		Config::Lookup<uint32_t>("iomanager.io_uring_entries", 256, "io_uring submission queue entries");
+	static ConfigVar<bool>::ptr g_iomanager_per_thread_timers =
+		Config::Lookup<bool>("iomanager.per_thread_timers", false
+			, "timers created on a worker live in that worker's own timing wheel, requires per thread epoll");
+	static ConfigVar<uint32_t>::ptr g_iomanager_max_events =
+		Config::Lookup<uint32_t>("iomanager.max_events", 256, "max events returned by one epoll_wait");
+	static ConfigVar<uint32_t>::ptr g_iomanager_max_timeout =
+		Config::Lookup<uint32_t>("iomanager.max_timeout", 3000, "max epoll_wait timeout in ms");
+	static ConfigVar<uint32_t>::ptr g_iomanager_busy_poll_us =
+		Config::Lookup<uint32_t>("iomanager.busy_poll_us", 0, "max us to busy poll before blocking, 0 to disable");
+	
+	static uint32_t s_max_events = 256;
+	static uint32_t s_max_timeout = 3000;
+	static uint32_t s_busy_poll_us = 0;
+	
+	struct _IOManagerIniter {
+		_IOManagerIniter() {
+			s_max_events = g_iomanager_max_events->getValue();
+			s_max_timeout = g_iomanager_max_timeout->getValue();
+			s_busy_poll_us = g_iomanager_busy_poll_us->getValue();
+			g_iomanager_max_events->addListener([](const uint32_t& old_value, const uint32_t& new_value){
+				s_max_events = new_value;
+			});
+			g_iomanager_max_timeout->addListener([](const uint32_t& old_value, const uint32_t& new_value){
+				s_max_timeout = new_value;
+			});
+			g_iomanager_busy_poll_us->addListener([](const uint32_t& old_value, const uint32_t& new_value){
+				s_busy_poll_us = new_value;
+			});
+		}
+	};
+	
+	static _IOManagerIniter s_iomanager_initer;
+	
+	static void OnIoTimeout(TimerNode* node, uint32_t seq);
+	
+	//ȴio_uringɵЭ̣λڸЭԼջϣʱڵҲǶУڴ
+	struct IoWaiter : public TimerNode {
+		IoWaiter()
+			:TimerNode(&OnIoTimeout) {
+		}
+		Scheduler* scheduler = nullptr;
+		Fiber::ptr fiber;
+		int res = 0;
+		IoUring* uring = nullptr;
+		uint64_t key = 0;
+		std::atomic<bool> timedOut = {false};		//ʱصѾִ֮꣬ٷwaiter
+	};
+	
+	static void OnIoTimeout(TimerNode* node, uint32_t seq) {
+		IoWaiter* waiter = static_cast<IoWaiter*>(node);
+		//ѾʱȡҲ󣬲Ӱ
+		waiter->uring->cancel(waiter->key);
+		waiter->timedOut.store(true, std::memory_order_release);
+	}
+	
 	//EventͷضӦEventContext¼
 	IOManager::FdContext::EventContext& IOManager::FdContext::getContext(IOManager::Event event) {
 		switch(event) {
@@ -28,102 +95,193 @@ namespace sylar {
 		ctx.cb = nullptr;
 	}
 	//eventsevent¼eventΪգӦ¼ķѾ壬ûӦЭ
-	void IOManager::FdContext::triggerEvent(IOManager::Event event) {
+	void IOManager::FdContext::triggerEvent(IOManager::Event event, Scheduler* owner, Scheduler::Batch* batch
+			, int thread) {
 		SYLAR_ASSERT(events & event);
 		events = (Event)(events & ~event);
 		EventContext& ctx = getContext(event);
-		if(ctx.cb) {
-			ctx.scheduler->schedule(&ctx.cb);
+		//߳idֻڱ
+		if(ctx.scheduler != owner) {
+			thread = -1;
+		}
+		if(batch && ctx.scheduler == owner) {
+			if(ctx.cb) {
+				batch->add(&ctx.cb, thread);
+			}
+			else {
+				batch->add(&ctx.fiber, thread);
+			}
+		}
+		else if(ctx.cb) {
+			ctx.scheduler->schedule(&ctx.cb, thread);
 		}
 		else {
-			ctx.scheduler->schedule(&ctx.fiber);
+			ctx.scheduler->schedule(&ctx.fiber, thread);
 		}
 		ctx.scheduler = nullptr;
 		return;
 	}
-	//һepollʾһܵùܵĶļԣ趨epoll_eventʹ¼
+	//һepollʾһeventfdڻѣ趨epoll_eventʹ¼
 	//ļepoll_event¼עᵽepollʾ
-	IOManager::IOManager(size_t threads, bool use_caller, const std::string& name)
-		:Scheduler(threads, use_caller, name) {
-		m_epfd = epoll_create(5000); // m_epfdһļ,ںepollʾĲ
-		SYLAR_ASSERT(m_epfd > 0);
+	static void CreateEpoll(int& epfd, int& tickle_fd, int flags) {
+		epfd = epoll_create(5000); // epfdһļ,ںepollʾĲ
+		SYLAR_ASSERT(epfd > 0);
 		
-		int rt = pipe(m_tickleFds);
-		SYLAR_ASSERT(!rt);
+		tickle_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC | flags);
+		SYLAR_ASSERT(tickle_fd >= 0);
 		epoll_event event;
 		memset(&event, 0, sizeof(epoll_event));
-		event.events = EPOLLIN | EPOLLET; // EPOLLIN: עɶ¼ EPOLLET: Ե
-		event.data.fd = m_tickleFds[0];
-		//fcntl: ޸ļ
-		rt = fcntl(m_tickleFds[0], F_SETFL, O_NONBLOCK); //ļm_tickleFds[0]Ϊ
-		SYLAR_ASSERT(!rt);										              //ģʽ
+		event.events = EPOLLIN; // EPOLLIN: עɶ¼
+		event.data.fd = tickle_fd;
 		
-		rt = epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_tickleFds[0], &event); //m_tickleFds[0]ļӵepollʾ
-		SYLAR_ASSERT(!rt);								
-		contextResize(32);															 //m_epfdУ趨Ӧ¼Ϊevent
+		int rt = epoll_ctl(epfd, EPOLL_CTL_ADD, tickle_fd, &event); //tickle_fdļӵepollʾ
+		SYLAR_ASSERT(!rt);
+	}
+	
+	IOManager::IOManager(size_t threads, bool use_caller, const std::string& name, bool per_thread_epoll)
+		:Scheduler(threads, use_caller, name)
+		,m_perThread(per_thread_epoll)
+		,m_persistent(g_iomanager_persistent_registration->getValue()) {
+		if(m_perThread) {
+			//ÿֻ߳ԼȴԼeventfdͨģʽһζ꼴
+			m_pollers.resize(getWorkerCount());
+			for(size_t i = 0; i < m_pollers.size(); ++i) {
+				m_pollers[i] = new Poller;
+				CreateEpoll(m_pollers[i]->epfd, m_pollers[i]->tickleFd, 0);
+			}
+		}
+		else {
+			//źģʽÿtickleд1ÿѵ̶߳1
+			//ˮƽ֤дڱ֮ǰһֱɶԵϲһ֪ͨ
+			CreateEpoll(m_epfd, m_tickleFd, EFD_SEMAPHORE);
+		}
+		if(g_iomanager_backend->getValue() == "io_uring") {
+			if(m_perThread) {
+				SYLAR_LOG_WARN(g_logger) << "io_uring backend does not support per thread epoll, use epoll";
+			}
+			else {
+				m_uring = new IoUring;
+				if(m_uring->init(g_iomanager_io_uring_entries->getValue())) {
+					//Եÿ¼ֻһ̣߳eventfdȡȫ¼
+					epoll_event event;
+					memset(&event, 0, sizeof(epoll_event));
+					event.events = EPOLLIN | EPOLLET;
+					event.data.fd = m_uring->getEventFd();
+					int rt = epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_uring->getEventFd(), &event);
+					SYLAR_ASSERT(!rt);
+				}
+				else {
+					SYLAR_LOG_WARN(g_logger) << "io_uring not available, fall back to epoll";
+					delete m_uring;
+					m_uring = nullptr;
+				}
+			}
+		}
+		//ļ޷һڵһõʱ䣬޹ʱ֧1<<24fd
+		rlimit limit;
+		size_t max_fds = 1 << 24;
+		if(getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_max != RLIM_INFINITY
+				&& limit.rlim_max < max_fds) {
+			max_fds = limit.rlim_max;
+		}
+		m_fdSegmentCount = (max_fds + FD_SEGMENT_SIZE - 1) >> FD_SEGMENT_BITS;
+		m_fdSegments = new std::atomic<FdSegment*>[m_fdSegmentCount];
+		for(size_t i = 0; i < m_fdSegmentCount; ++i) {
+			m_fdSegments[i] = nullptr;
+		}
+		//Ƭ߳Ҫܱѣֻÿ߳epollģʽ
+		if(g_iomanager_per_thread_timers->getValue()) {
+			if(m_perThread) {
+				initTimerShards(m_pollers.size());
+			}
+			else {
+				SYLAR_LOG_WARN(g_logger) << "per thread timers require per thread epoll, use shared timers";
+			}
+		}
 
 		start();
 	}
 	
 	IOManager::~IOManager() {
 		stop();
-		close(m_epfd);
-		close(m_tickleFds[0]);
-		close(m_tickleFds[1]);
-		
-		for(size_t i = 0; i < m_fdContexts.size(); ++i) {
-			if(m_fdContexts[i]) {
-				delete m_fdContexts[i];
+		if(m_perThread) {
+			for(auto i : m_pollers) {
+				close(i->epfd);
+				close(i->tickleFd);
+				delete i;
 			}
 		}
-	}
-	//m_fdContexts
-	void IOManager::contextResize(size_t size) {
-		m_fdContexts.resize(size);
+		else {
+			close(m_epfd);
+			close(m_tickleFd);
+		}
+		if(m_uring) {
+			delete m_uring;
+		}
 		
-		for(size_t i = 0; i < m_fdContexts.size(); ++i) {
-			if(!m_fdContexts[i]) {
-				m_fdContexts[i] = new FdContext;
-				m_fdContexts[i]->fd = i;
+		for(size_t i = 0; i < m_fdSegmentCount; ++i) {
+			FdSegment* seg = m_fdSegments[i];
+			if(!seg) {
+				continue;
 			}
+			for(size_t j = 0; j < FD_SEGMENT_SIZE; ++j) {
+				if(seg->ctxs[j]) {
+					delete seg->ctxs[j];
+				}
+			}
+			delete seg;
 		}
+		delete[] m_fdSegments;
 	}
 	
 	//epollʾжfdļעevent¼ļcb¼
 	//0 success, -1 error
 	int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
-		FdContext* fd_ctx = nullptr;
-		RWMutexType::ReadLock lock(m_mutex);
-		if((int)m_fdContexts.size() > fd) {
-			fd_ctx = m_fdContexts[fd];
-			lock.unlock();
-		}
-		else {
-			lock.unlock();
-			RWMutexType::WriteLock lock2(m_mutex);
-			contextResize(fd * 1.5);
-			fd_ctx = m_fdContexts[fd];
+		FdContext* fd_ctx = getFdContext(fd, true);
+		if(!fd_ctx) {
+			SYLAR_LOG_RATELIMITED(g_logger, sylar::LogLevel::ERROR, 10) << "addEvent fd=" << fd << " out of range";
+			return -1;
 		}
 		
 		FdContext::MutexType::Lock lock2(fd_ctx->mutex);
 		if(fd_ctx->events & event) {
-			SYLAR_LOG_ERROR(g_logger) << "addEvent assert fd=" << fd
+			SYLAR_LOG_RATELIMITED(g_logger, sylar::LogLevel::ERROR, 10) << "addEvent assert fd=" << fd
 					<< " event=" << event
 					<< " fd_ctx.event=" << fd_ctx->events;
 			SYLAR_ASSERT(!(fd_ctx->events & event));
 		}
-		
-		int op = fd_ctx->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
-		epoll_event epevent;
-		epevent.events = EPOLLET | fd_ctx->events | event;
-		epevent.data.ptr = fd_ctx;
-		
-		int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-		if(rt) {
-			SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-					<< op << "," << fd << ", " << epevent.events << "):"
-					<< rt << " (" << errno << ") (" << strerror(errno) << ")";
-			return -1;		
+		//һעʱ󶨵ǰ̣߳ǹ߳ע󶨵߳
+		//߳Ҫstop()ʱŽȣ
+		if(m_perThread && fd_ctx->poller == -1) {
+			int index = Scheduler::GetThis() == this ? GetWorkerIndex() : -1;
+			if(index >= 0) {
+				m_pollers[index]->threadId = sylar::GetThreadId();
+			}
+			else {
+				index = m_nextPoller++ % (m_threadCount ? m_threadCount : m_pollers.size());
+			}
+			fd_ctx->poller = index;
+		}
+		//־עģʽ£ûеȴʱıԵѾ¼readyУٴ֪ͨ
+		if(m_persistent && (fd_ctx->ready & event)) {
+			fd_ctx->ready = (Event)(fd_ctx->ready & ~event);
+			return 1;
+		}
+		if(!m_persistent || !fd_ctx->registered) {
+			int epfd = getEpfd(fd_ctx);
+			int op = fd_ctx->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+			epoll_event epevent;
+			epevent.events = EPOLLET | (m_persistent ? EPOLLIN | EPOLLOUT : fd_ctx->events | event);
+			epevent.data.ptr = fd_ctx;
+			
+			int rt = epoll_ctl(epfd, op, fd, &epevent);
+			if(rt) {
+				SYLAR_LOG_RATELIMITED(g_logger, sylar::LogLevel::ERROR, 10) << "epoll_ctl(" << epfd << ", "
+						<< op << "," << fd << ", " << epevent.events << "):"
+						<< rt << " (" << errno << ") (" << strerror(errno) << ")";
+				return -1;		
+			}
+			fd_ctx->registered = m_persistent;
 		}
 		
 		++m_pendingEventCount;
@@ -143,29 +301,31 @@ namespace sylar {
 	
 	//fdļɾevent¼
 	bool IOManager::delEvent(int fd, Event event) {
-		RWMutexType::ReadLock lock(m_mutex);
-		if((int)m_fdContexts.size() <= fd) {
+		FdContext* fd_ctx = getFdContext(fd);
+		if(!fd_ctx) {
 			return false;
 		}
-		FdContext* fd_ctx = m_fdContexts[fd];
-		lock.unlock();
 		FdContext::MutexType::Lock lock2(fd_ctx->mutex);
 		if(!(fd_ctx->events & event)) {
 			return false;
 		}
 		
 		Event new_events = (Event)(fd_ctx->events & ~event);
-		int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-		epoll_event epevent;
-		epevent.events = EPOLLET | new_events;
-		epevent.data.ptr = fd_ctx;
-		
-		int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-		if(rt) {
-			SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-					<< op << "," << fd << ", " << epevent.events << "):"
-					<< rt << " (" << errno << ") (" << strerror(errno) << ")";
-			return false;
+		//־עģʽעᱣֲ䣬ֻȥȴ
+		if(!m_persistent) {
+			int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+			epoll_event epevent;
+			epevent.events = EPOLLET | new_events;
+			epevent.data.ptr = fd_ctx;
+			
+			int epfd = getEpfd(fd_ctx);
+			int rt = epoll_ctl(epfd, op, fd, &epevent);
+			if(rt) {
+				SYLAR_LOG_RATELIMITED(g_logger, sylar::LogLevel::ERROR, 10) << "epoll_ctl(" << epfd << ", "
+						<< op << "," << fd << ", " << epevent.events << "):"
+						<< rt << " (" << errno << ") (" << strerror(errno) << ")";
+				return false;
+			}
 		}
 		--m_pendingEventCount;
 		fd_ctx->events = new_events;
@@ -174,88 +334,344 @@ namespace sylar {
 		return true;
 	}
 	
+	IOManager::EventTimeout::EventTimeout()
+		:TimerNode(&IOManager::OnEventTimeout) {
+	}
+	
+	int IOManager::waitEvent(int fd, Event event, uint64_t timeout_ms, uint32_t& seq) {
+		int rt = addEvent(fd, event);
+		if(rt || timeout_ms == ~0ull) {
+			seq = 0;
+			return rt;
+		}
+		FdContext* fd_ctx = getFdContext(fd);
+		FdContext::MutexType::Lock lock(fd_ctx->mutex);
+		//עûг¼ֻܱcancelEvent/cancelAllǰʱҪʱ
+		if(!(fd_ctx->events & event)) {
+			seq = 0;
+			return 0;
+		}
+		EventTimeout& timeout = fd_ctx->getContext(event).timeout;
+		timeout.iom = this;
+		timeout.fdCtx = fd_ctx;
+		timeout.event = event;
+		//ڼӣʱصҲҪȼͬһһǱε
+		seq = addTimerNode(&timeout, timeout_ms);
+		return 0;
+	}
+	
+	bool IOManager::finishWait(int fd, Event event, uint32_t seq) {
+		if(!seq) {
+			return false;
+		}
+		FdContext* fd_ctx = getFdContext(fd);
+		FdContext::MutexType::Lock lock(fd_ctx->mutex);
+		EventTimeout& timeout = fd_ctx->getContext(event).timeout;
+		cancelTimerNode(&timeout);
+		return timeout.timedOut == seq;
+	}
+	
+	void IOManager::OnEventTimeout(TimerNode* node, uint32_t seq) {
+		EventTimeout* timeout = static_cast<EventTimeout*>(node);
+		FdContext* fd_ctx = timeout->fdCtx;
+		FdContext::MutexType::Lock lock(fd_ctx->mutex);
+		//ѾӣǰһεȴѽߵȴѾIO¼
+		if(timeout->getSeq() != seq || !(fd_ctx->events & timeout->event)) {
+			return;
+		}
+		timeout->timedOut = seq;
+		timeout->iom->cancelEvent(fd_ctx, timeout->event);
+	}
+	
 	//epollʵɾfdעevent¼Ҵ¼
 	bool IOManager::cancelEvent(int fd, Event event) {
-		RWMutexType::ReadLock lock(m_mutex);
-		if((int)m_fdContexts.size() <= fd) {
+		FdContext* fd_ctx = getFdContext(fd);
+		if(!fd_ctx) {
 			return false;
 		}
-		FdContext* fd_ctx = m_fdContexts[fd];
-		lock.unlock();
 		FdContext::MutexType::Lock lock2(fd_ctx->mutex);
+		return cancelEvent(fd_ctx, event);
+	}
+	
+	bool IOManager::cancelEvent(FdContext* fd_ctx, Event event) {
+		int fd = fd_ctx->fd;
 		if(!(fd_ctx->events & event)) {
 			return false;
 		}
 		
 		Event new_events = (Event)(fd_ctx->events & ~event);
-		int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-		epoll_event epevent;
-		epevent.events = EPOLLET | new_events;
-		epevent.data.ptr = fd_ctx;
-		
-		int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-		if(rt) {
-			SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-					<< op << "," << fd << ", " << epevent.events << "):"
-					<< rt << " (" << errno << ") (" << strerror(errno) << ")";
-			return false;
+		//־עģʽעᱣֲ䣬ֻȥȴ
+		if(!m_persistent) {
+			int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+			epoll_event epevent;
+			epevent.events = EPOLLET | new_events;
+			epevent.data.ptr = fd_ctx;
+			
+			int epfd = getEpfd(fd_ctx);
+			int rt = epoll_ctl(epfd, op, fd, &epevent);
+			if(rt) {
+				SYLAR_LOG_RATELIMITED(g_logger, sylar::LogLevel::ERROR, 10) << "epoll_ctl(" << epfd << ", "
+						<< op << "," << fd << ", " << epevent.events << "):"
+						<< rt << " (" << errno << ") (" << strerror(errno) << ")";
+				return false;
+			}
 		}
-		fd_ctx->triggerEvent(event);
+		fd_ctx->triggerEvent(event, this, nullptr, getEventThread(fd_ctx));
 		--m_pendingEventCount;
 		return true;
 	}
 	
 	//ɾfdepollʵע¼һһ
 	bool IOManager::cancelAll(int fd) {
-		RWMutexType::ReadLock lock(m_mutex);
-		if((int)m_fdContexts.size() <= fd) {
+		FdContext* fd_ctx = getFdContext(fd);
+		if(!fd_ctx) {
 			return false;
 		}
-		FdContext* fd_ctx = m_fdContexts[fd];
-		lock.unlock();
 		FdContext::MutexType::Lock lock2(fd_ctx->mutex);
-		if(!fd_ctx->events) {
+		//ͨcloseʱãfdܱ֮Ӹã¼̰߳
+		fd_ctx->ready = NONE;
+		if(!fd_ctx->events && !fd_ctx->registered) {
+			fd_ctx->poller = -1;
 			return false;
 		}
 		
-		int op = EPOLL_CTL_DEL;
-		epoll_event epevent;
-		epevent.events = 0;
-		epevent.data.ptr = fd_ctx;
-		
-		int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-		if(rt) {
-			SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-					<< op << "," << fd << ", " << epevent.events << "):"
-					<< rt << " (" << errno << ") (" << strerror(errno) << ")";
-			return false;
+		if(!m_persistent || fd_ctx->registered) {
+			int op = EPOLL_CTL_DEL;
+			epoll_event epevent;
+			epevent.events = 0;
+			epevent.data.ptr = fd_ctx;
+			
+			int epfd = getEpfd(fd_ctx);
+			int rt = epoll_ctl(epfd, op, fd, &epevent);
+			if(rt) {
+				SYLAR_LOG_RATELIMITED(g_logger, sylar::LogLevel::ERROR, 10) << "epoll_ctl(" << epfd << ", "
+						<< op << "," << fd << ", " << epevent.events << "):"
+						<< rt << " (" << errno << ") (" << strerror(errno) << ")";
+				return false;
+			}
+			fd_ctx->registered = false;
 		}
 		
+		int thread = getEventThread(fd_ctx);
 		if(fd_ctx->events & READ) {
-			fd_ctx->triggerEvent(READ);
+			fd_ctx->triggerEvent(READ, this, nullptr, thread);
 			--m_pendingEventCount;
 		}
 		if(fd_ctx->events & WRITE) {
-			fd_ctx->triggerEvent(WRITE);
+			fd_ctx->triggerEvent(WRITE, this, nullptr, thread);
 			--m_pendingEventCount;
 		}
 		SYLAR_ASSERT(fd_ctx->events == 0);
+		fd_ctx->poller = -1;
+		return true;
+	}
+	
+	//߳ͬʱͬһλFdContextʱͨCASһʧܵһͷԼ
+	IOManager::FdContext* IOManager::getFdContext(int fd, bool auto_create) {
+		size_t index = fd >> FD_SEGMENT_BITS;
+		if(fd < 0 || index >= m_fdSegmentCount) {
+			return nullptr;
+		}
+		FdSegment* seg = m_fdSegments[index].load(std::memory_order_acquire);
+		if(!seg) {
+			if(!auto_create) {
+				return nullptr;
+			}
+			FdSegment* new_seg = new FdSegment();
+			if(m_fdSegments[index].compare_exchange_strong(seg, new_seg, std::memory_order_acq_rel)) {
+				seg = new_seg;
+			}
+			else {
+				delete new_seg;
+			}
+		}
+		std::atomic<FdContext*>& slot = seg->ctxs[fd & (FD_SEGMENT_SIZE - 1)];
+		FdContext* fd_ctx = slot.load(std::memory_order_acquire);
+		if(!fd_ctx && auto_create) {
+			FdContext* new_ctx = new FdContext;
+			new_ctx->fd = fd;
+			if(slot.compare_exchange_strong(fd_ctx, new_ctx, std::memory_order_acq_rel)) {
+				fd_ctx = new_ctx;
+			}
+			else {
+				delete new_ctx;
+			}
+		}
+		return fd_ctx;
+	}
+	
+	int IOManager::getEpfd(FdContext* fd_ctx) {
+		if(m_perThread) {
+			SYLAR_ASSERT(fd_ctx->poller >= 0);
+			return m_pollers[fd_ctx->poller]->epfd;
+		}
+		return m_epfd;
+	}
+	
+	int IOManager::getEventThread(FdContext* fd_ctx) {
+		if(!m_perThread || fd_ctx->poller < 0) {
+			return -1;
+		}
+		return m_pollers[fd_ctx->poller]->threadId;
+	}
+	
+	int IOManager::getFdPoller(int fd) {
+		FdContext* fd_ctx = getFdContext(fd);
+		if(!m_perThread || !fd_ctx) {
+			return -1;
+		}
+		FdContext::MutexType::Lock lock(fd_ctx->mutex);
+		return fd_ctx->poller;
+	}
+	
+	//̵߳epollʵעᣬٴԭʵɾ
+	//ԭ߳Ѿȡû¼ȻЧʱµİ޸עᣬЭִ߳
+	bool IOManager::migrateFd(int fd, size_t poller) {
+		if(!m_perThread || poller >= m_pollers.size()) {
+			return false;
+		}
+		FdContext* fd_ctx = getFdContext(fd);
+		if(!fd_ctx) {
+			return false;
+		}
+		FdContext::MutexType::Lock lock(fd_ctx->mutex);
+		if(fd_ctx->poller == (int)poller) {
+			return true;
+		}
+		if(fd_ctx->events || fd_ctx->registered) {
+			epoll_event epevent;
+			epevent.events = EPOLLET | (fd_ctx->registered ? EPOLLIN | EPOLLOUT : (uint32_t)fd_ctx->events);
+			epevent.data.ptr = fd_ctx;
+			int epfd = m_pollers[poller]->epfd;
+			int rt = epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &epevent);
+			if(rt) {
+				SYLAR_LOG_RATELIMITED(g_logger, sylar::LogLevel::ERROR, 10) << "epoll_ctl(" << epfd << ", "
+						<< EPOLL_CTL_ADD << "," << fd << ", " << epevent.events << "):"
+						<< rt << " (" << errno << ") (" << strerror(errno) << ")";
+				return false;
+			}
+			epfd = getEpfd(fd_ctx);
+			rt = epoll_ctl(epfd, EPOLL_CTL_DEL, fd, &epevent);
+			if(rt) {
+				SYLAR_LOG_RATELIMITED(g_logger, sylar::LogLevel::ERROR, 10) << "epoll_ctl(" << epfd << ", "
+						<< EPOLL_CTL_DEL << "," << fd << ", " << epevent.events << "):"
+						<< rt << " (" << errno << ") (" << strerror(errno) << ")";
+			}
+		}
+		fd_ctx->poller = poller;
 		return true;
 	}
 	
+	//ǰǰЭһֱ𣬵ȴϢֱӷЭջ
+	//ʱɶʱȡ󣬱ȡ-ECANCELEDɣٻ-ETIMEDOUT
+	bool IOManager::submitIo(const io_uring_sqe& sqe, uint64_t timeout_ms, int& res) {
+		if(!m_uring) {
+			return false;
+		}
+		Fiber::ptr fiber = Fiber::GetThis();
+		if(fiber->isSharedStack()) {
+			return false;
+		}
+		IoWaiter waiter;
+		waiter.scheduler = Scheduler::GetThis();
+		waiter.fiber = fiber;
+		waiter.uring = m_uring;
+		uint64_t key = ++m_ioRequestId;
+		waiter.key = key;
+		{
+			Spinlock::Lock lock(m_ioMutex);
+			m_ioWaiters[key] = &waiter;
+		}
+		++m_pendingEventCount;
+		if(!m_uring->submit(sqe, key)) {
+			--m_pendingEventCount;
+			Spinlock::Lock lock(m_ioMutex);
+			m_ioWaiters.erase(key);
+			return false;
+		}
+		
+		//io_uring˲֧ÿ߳epollҲûжʱƬڵڹʱУ
+		//ȡĽȷģfalse˵صѾȡ
+		if(timeout_ms != ~0ull) {
+			addTimerNode(&waiter, timeout_ms);
+		}
+		fiber.reset();
+		Fiber::YieldToHold();
+		if(timeout_ms != ~0ull && !cancelTimerNode(&waiter)) {
+			//Ѿڣʱصִ֮ǰwaiterջ֡ͷ
+			while(!waiter.timedOut.load(std::memory_order_acquire)) {
+				Fiber::YieldToReady();
+			}
+		}
+		res = waiter.res;
+		if(res == -ECANCELED && waiter.timedOut) {
+			res = -ETIMEDOUT;
+		}
+		return true;
+	}
+	
+	void IOManager::cancelIo(int fd) {
+		if(m_uring) {
+			m_uring->cancelFd(fd);
+		}
+	}
+	
 	IOManager* IOManager::GetThis() {
 		return dynamic_cast<IOManager*>(Scheduler::GetThis());
 	}
 	
-	//ڹܵдд
+	//һepoll_waitе߳
+	//ռһδ֪ͨ˯߳дeventfdû˯߳ʱϵͳã
+	//tickle໽ͬ˯߳
 	void IOManager::tickle() {
-		if(!hasIdleThreads()) {
+		uint64_t requested = m_tickleRequested++;
+		if(m_perThread) {
+			//Ӳͬλÿʼңǻͬһ߳
+			size_t n = m_pollers.size();
+			for(size_t i = 0; i < n; ++i) {
+				if(wakePoller(m_pollers[(requested + i) % n])) {
+					return;
+				}
+			}
 			return;
 		}
-		//дɹrtΪдֽ,δʾm_tickleFds[1]ļ
-		//д볤Ϊ1ݣΪ"T""
-		int rt = write(m_tickleFds[1], "T", 1);
-		SYLAR_ASSERT(rt == 1);
+		int sleeping = m_sleepingThreads;
+		while(sleeping > 0) {
+			if(m_sleepingThreads.compare_exchange_weak(sleeping, sleeping - 1)) {
+				uint64_t one = 1;
+				int rt = write(m_tickleFd, &one, sizeof(one));
+				SYLAR_ASSERT(rt == sizeof(one));
+				++m_tickleSent;
+				return;
+			}
+		}
+	}
+	
+	//ÿ߳epollģʽָֻ̣߳߳û˯ʱڽ˯ǰԼ鵽
+	void IOManager::tickleThread(int thread) {
+		if(!m_perThread || thread == -1) {
+			tickle();
+			return;
+		}
+		++m_tickleRequested;
+		for(auto i : m_pollers) {
+			if(i->threadId == thread) {
+				wakePoller(i);
+				return;
+			}
+		}
+	}
+	
+	bool IOManager::wakePoller(Poller* poller) {
+		bool sleeping = true;
+		if(!poller->sleeping.compare_exchange_strong(sleeping, false)) {
+			return false;
+		}
+		uint64_t one = 1;
+		int rt = write(poller->tickleFd, &one, sizeof(one));
+		SYLAR_ASSERT(rt == sizeof(one));
+		++m_tickleSent;
+		return true;
 	}
 	
   bool IOManager::stopping() {
@@ -265,57 +681,177 @@ namespace sylar {
   
   //ȴ¼Ȼ
 	void IOManager::idle() {
-		epoll_event* events = new epoll_event[64]();
-		//ԶɾĹָ
-		std::shared_ptr<epoll_event> shared_events(events, [](epoll_event* ptr){
-			delete[] ptr;
-		});
+		//iomanager.max_events޸ĺһЧ
+		std::vector<epoll_event> event_buf(s_max_events ? s_max_events : 1);
+		epoll_event* events = &event_buf[0];
+		std::vector<std::function<void()>> cbs;
+		//æѯʱʱָΪֵʱ룬Ϊֵ1/8
+		uint32_t busy_poll_cfg = s_busy_poll_us;
+		uint32_t busy_poll_us = busy_poll_cfg;
+		//ÿ߳epollģʽʹñ̵߳epollʵeventfd
+		Poller* poller = nullptr;
+		int epfd = m_epfd;
+		int tickle_fd = m_tickleFd;
+		if(m_perThread) {
+			int index = GetWorkerIndex();
+			SYLAR_ASSERT(index >= 0 && index < (int)m_pollers.size());
+			poller = m_pollers[index];
+			poller->threadId = sylar::GetThreadId();
+			epfd = poller->epfd;
+			tickle_fd = poller->tickleFd;
+		}
 		
 		while(true) {
 			uint64_t next_timeout = 0;
 			//ִֹͣ
 			if(stopping(next_timeout)) {
 				SYLAR_LOG_INFO(g_logger) << "name=" << getName() << " idle stopping exit";
+				//û˯߳ʱtickleᱣλepoll_waitе߳Ҳ˳
+				tickle();
 				break;			
 			}
 			
+			if(event_buf.size() != s_max_events && s_max_events) {
+				event_buf.resize(s_max_events);
+				events = &event_buf[0];
+			}
+			int max_events = event_buf.size();
+			if(busy_poll_cfg != s_busy_poll_us) {
+				busy_poll_cfg = s_busy_poll_us;
+				busy_poll_us = busy_poll_cfg;
+			}
+			
 			int rt = 0;
-			//ȴһ¼
-			do {
-				static const int MAX_TIMEOUT = 3000;
-				if(next_timeout != ~0ull) {
-					next_timeout = (int)next_timeout > MAX_TIMEOUT ? MAX_TIMEOUT : next_timeout;
+			bool busy_hit = false;
+			//Ӧæѯ֮ǰóʱΪ0epoll_waitѯһʱ䣬ڼIO¼ʡһ˯ߺͻ
+			//epollģʽtickleeventfdˮƽģ˯̵߳ģҲȡ
+			if(busy_poll_us && next_timeout != 0 && !hasWork()) {
+				++m_busyPolls;
+				uint64_t limit = busy_poll_us;
+				if(next_timeout != ~0ull && next_timeout * 1000 < limit) {
+					limit = next_timeout * 1000;
+				}
+				uint64_t start = GetMonotonicUS();
+				do {
+					rt = epoll_wait(epfd, events, max_events, 0);
+					busy_hit = (rt > 0 && !(rt == 1 && events[0].data.fd == tickle_fd)) || hasWork();
+				} while(!busy_hit && GetMonotonicUS() - start < limit);
+				if(busy_hit) {
+					++m_busyPollHits;
+					busy_poll_us = busy_poll_cfg;
 				}
 				else {
-					next_timeout = MAX_TIMEOUT;
+					busy_poll_us = std::max(busy_poll_us / 2, busy_poll_cfg / 8);
+					rt = 0;
 				}
-				//rtʾȴڼ䷢¼,epoll_waitڴֱm_epfdļ
-				//һ¼ڶeventsΪ¼͵飬洢¼ϢΪСΪʱʱ
-				//û¼ֵΪ0
-				rt = epoll_wait(m_epfd, events, 64, (int)next_timeout);
-				
-				if(rt < 0 && errno == EINTR) {
-					
+			}
+			
+			bool slept = !busy_hit;
+			if(slept) {
+				//ȵǼΪ˯߳ټһУschedule()ʱ©
+				if(poller) {
+					poller->sleeping = true;
+				}
+				else {
+					++m_sleepingThreads;
+				}
+				if(hasWork() || hasPendingTimerOps()) {
+					next_timeout = 0;
 				}
 				else {
-					break;
+					//Ǽ֮ǰ¼ӵǰĶʱtickleҲ˯̣߳дeventfd
+					//Ǽ֮¼һεȴʱ䣬֮ټĻῴ߳˯
+					next_timeout = getNextTimer();
+				}
+				//ȴһ¼
+				do {
+					if(next_timeout != ~0ull) {
+						next_timeout = next_timeout > s_max_timeout ? s_max_timeout : next_timeout;
+					}
+					else {
+						next_timeout = s_max_timeout;
+					}
+					//rtʾȴڼ䷢¼,epoll_waitڴֱm_epfdļ
+					//һ¼ڶeventsΪ¼͵飬洢¼ϢΪСΪʱʱ
+					//û¼ֵΪ0
+					rt = epoll_wait(epfd, events, max_events, (int)next_timeout);
+					
+					if(rt < 0 && errno == EINTR) {
+						
+					}
+					else {
+						break;
+					}
+				}
+				while(true);
+			}
+			//һѼ˵ѱtickleռãIO¼ʱ߼̶߳ߣԼ˳˯ߵǼ
+			bool tickled = false;
+			int uring_fd = m_uring ? m_uring->getEventFd() : -1;
+			for(int i = 0; i < rt; ++i) {
+				if(events[i].data.fd == tickle_fd) {
+					if(slept) {
+						uint64_t dummy;
+						tickled = read(tickle_fd, &dummy, sizeof(dummy)) == sizeof(dummy);
+					}
+				}
+				else if(events[i].data.fd == uring_fd) {
+					//ȶռȡ¼֮ɵ¼´
+					uint64_t dummy;
+					while(read(uring_fd, &dummy, sizeof(dummy)) == sizeof(dummy)) {
+					}
+				}
+			}
+			if(slept) {
+				if(poller) {
+					poller->sleeping = false;
+				}
+				else if(!tickled) {
+					int sleeping = m_sleepingThreads;
+					while(sleeping > 0
+							&& !m_sleepingThreads.compare_exchange_weak(sleeping, sleeping - 1)) {
+					}
 				}
 			}
-			while(true);
-			std::vector<std::function<void()>> cbs;
+			//ֵڵĶʱ;IO¼ռͬһΣһύ
+			Batch batch;
 			listExpiredCb(cbs);
-			if(!cbs.empty()) {
-				schedule(cbs.begin(), cbs.end());
-				cbs.clear();
+			for(auto& cb : cbs) {
+				batch.add(&cb);
+			}
+			cbs.clear();
+			//ɵio_uring󣬻ָȴЭ
+			if(m_uring && m_uring->hasCompletions()) {
+				io_uring_cqe cqes[64];
+				size_t n = 0;
+				while((n = m_uring->reap(cqes, 64)) > 0) {
+					for(size_t i = 0; i < n; ++i) {
+						IoWaiter* waiter = nullptr;
+						{
+							Spinlock::Lock lock(m_ioMutex);
+							auto it = m_ioWaiters.find(cqes[i].user_data);
+							SYLAR_ASSERT(it != m_ioWaiters.end());
+							waiter = it->second;
+							m_ioWaiters.erase(it);
+						}
+						waiter->res = cqes[i].res;
+						Fiber::ptr fiber;
+						fiber.swap(waiter->fiber);
+						//Эָ̻waiter漴ʧЧ֮ٷ
+						if(waiter->scheduler == this) {
+							batch.add(&fiber);
+						}
+						else {
+							waiter->scheduler->schedule(&fiber);
+						}
+						--m_pendingEventCount;
+					}
+				}
 			}
 			//
 			for(int i = 0; i < rt; ++i) {
 				epoll_event& event = events[i];
-				if(event.data.fd == m_tickleFds[0]) {
-					uint8_t dummy;
-					//ȡm_fickleFds[0]ļеݣ洢dummy
-					//ȡɹread()ضȡֽڳ
-					while(read(m_tickleFds[0], &dummy, 1) == 1); 
+				if(event.data.fd == tickle_fd || event.data.fd == uring_fd) {
 					continue;
 				}
 				FdContext* fd_ctx = (FdContext*)event.data.ptr;
@@ -331,31 +867,42 @@ namespace sylar {
 					real_events |= WRITE;
 				}
 				
-				if(!(fd_ctx->events & real_events)) {
-					continue;
+				//־עģʽעᱣֲ䣬ûеȴߵľ¼¼´addEventֱӷ
+				if(m_persistent) {
+					fd_ctx->ready = (Event)(fd_ctx->ready | (real_events & ~fd_ctx->events));
 				}
-				
-				int left_events = (fd_ctx->events & ~real_events);
-				int op = left_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-				event.events = EPOLLET | left_events;
-				
-				int rt2 = epoll_ctl(m_epfd, op, fd_ctx->fd, &event);
-				if(rt2) {
-					SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-					<< op << "," << fd_ctx->fd << ", " << event.events << "):"
-					<< rt2 << " (" << errno << ") (" << strerror(errno) << ")";
+				//EPOLLERR/EPOLLHUPʱֻеȴߵ
+				real_events &= fd_ctx->events;
+				if(!real_events) {
 					continue;
 				}
+				if(!m_persistent) {
+					int left_events = (fd_ctx->events & ~real_events);
+					int op = left_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+					event.events = EPOLLET | left_events;
+					
+					//fdѾǨƵ̣߳ǰ޸ע
+					int fd_epfd = getEpfd(fd_ctx);
+					int rt2 = epoll_ctl(fd_epfd, op, fd_ctx->fd, &event);
+					if(rt2) {
+						SYLAR_LOG_RATELIMITED(g_logger, sylar::LogLevel::ERROR, 10) << "epoll_ctl(" << fd_epfd << ", "
+						<< op << "," << fd_ctx->fd << ", " << event.events << "):"
+						<< rt2 << " (" << errno << ") (" << strerror(errno) << ")";
+						continue;
+					}
+				}
 				
+				int thread = getEventThread(fd_ctx);
 				if(real_events & READ) {
-					fd_ctx->triggerEvent(READ);
+					fd_ctx->triggerEvent(READ, this, &batch, thread);
 					--m_pendingEventCount;
 				}
 				if(real_events & WRITE) {
-					fd_ctx->triggerEvent(WRITE);
+					fd_ctx->triggerEvent(WRITE, this, &batch, thread);
 					--m_pendingEventCount;
 				}
 			}
+			schedule(batch);
 			
 			Fiber::ptr cur = Fiber::GetThis();
 			auto raw_ptr = cur.get();
@@ -368,9 +915,20 @@ namespace sylar {
 		tickle();
 	}
 	
+	int IOManager::getTimerShard() {
+		return Scheduler::GetThis() == this ? GetWorkerIndex() : -1;
+	}
+	
+	void IOManager::onTimerShardNotify(int shard) {
+		++m_tickleRequested;
+		wakePoller(m_pollers[shard]);
+	}
+	
 	bool IOManager::stopping(uint64_t& timeout) {
 		timeout = getNextTimer();
+		//̷߳ƬеĶʱӰ챾̵߳ĵȴʱ䣬û֮ǰֹͣ
 		return timeout == ~0ull
+			&& !hasTimer()
 			&& m_pendingEventCount == 0
 			&& Scheduler::stopping();
 	}
@@ -3,9 +3,15 @@
 
 #include "scheduler.h"
 #include "timer.h"
+#include<unordered_map>
+
+struct io_uring_sqe;
 
 namespace sylar {
 
+class IoUring;
+struct IoWaiter;
+
 class IOManager : public Scheduler, public TimerManager {
 public:
 	typedef std::shared_ptr<IOManager> ptr;
@@ -16,6 +22,15 @@ public:
 		WRITE = 0x4, //EPOLLOUT
 	};
 private:
+	struct FdContext;
+	//waitEventĳʱʱǶEventContextУFdContextһֱ
+	struct EventTimeout : public TimerNode {
+		EventTimeout();
+		IOManager* iom = nullptr;
+		FdContext* fdCtx = nullptr;
+		Event event = NONE;
+		uint32_t timedOut = 0;		//һΪʱĵȴ
+	};
 	//ļ
 	struct FdContext {
 		typedef Mutex MutexType;
@@ -23,45 +38,143 @@ private:
 			Scheduler* scheduler = nullptr; 		//¼ִеscheduler
 			Fiber::ptr fiber;										//¼Э
 			std::function<void()> cb; 					//¼Ļص
+			EventTimeout timeout;
 		};
 		
 		EventContext& getContext(Event event);
 		void resetContext(EventContext& ctx);
-		void triggerEvent(Event event);
+		//batchΪ¼ownerʱbatchɵͳһύ
+		//¼ownerʱָthreadִ߳
+		void triggerEvent(Event event, Scheduler* owner = nullptr, Scheduler::Batch* batch = nullptr
+				, int thread = -1);
 		EventContext read;										//¼
 		EventContext write;										//д¼
 		int fd = 0;												   	//¼ľ
 		Event events = NONE;  								//Ѿע¼
+		int poller = -1;										//ÿ߳epollģʽ°󶨵Ĺ߳±
+		Event ready = NONE;										//־עģʽûеȴʱľ¼
+		bool registered = false;							//־עģʽǷѾepoll
 		MutexType mutex;					
 	};
+	//fdĶΣFdContextһõʱ䣬ַ֮䣬ֱIOManager
+	static const size_t FD_SEGMENT_BITS = 10;
+	static const size_t FD_SEGMENT_SIZE = 1 << FD_SEGMENT_BITS;
+	struct FdSegment {
+		std::atomic<FdContext*> ctxs[FD_SEGMENT_SIZE];
+	};
+	//ÿ߳epollģʽÿ̶߳ռepollʵ
+	struct Poller {
+		int epfd = -1;
+		int tickleFd = -1;									//ѱ̵߳eventfd
+		std::atomic<bool> sleeping = {false};	//Ƿepoll_waitһûб֪ͨ
+		std::atomic<int> threadId = {-1};		//߳id̵߳һνidle()
+	};
 	
 public:
-	IOManager(size_t threads = 1, bool use_caller = true, const std::string& name = "");
+	//per_thread_epollΪtrueʱÿ߳ʹöepollʵfd󶨵һΪע¼Ḷ́߳
+	//Э̶̹صִ߳У̼߳ǨƣSO_REUSEPORTΪÿ̼߳ͬһ˿ڿ԰̻߳
+	//ǹ߳עfd󶨵߳
+	//iomanager.persistent_registrationΪtrueʱfdһaddEventEPOLLIN|EPOLLOUT|EPOLLETepoll
+	//ֱcancelAllhookcloseɾȴʹٵepoll_ctlģʽfdͨhookcloseر
+	//ÿ߳epollģʽiomanager.per_thread_timersΪtrueʱ߳ϴĶʱ߳Լʱ֣
+	//ڸ̵߳idle()дɾ̶߳ĲͨϢн߳
+	//iomanager.backendΪio_uringʱepollģʽhookĶдacceptconnectΪύio_uring
+	//ں˲֧ʱ˵epoll
+	IOManager(size_t threads = 1, bool use_caller = true, const std::string& name = ""
+			, bool per_thread_epoll = false);
 	~IOManager();
 	
 	//0 success -1 error
+	//1 ־עģʽ¼ûеȴʱѾûעȴӦֱIO
 	int addEvent(int fd, Event event, std::function<void()> cb = nullptr);
+	//ΪǰЭעevent¼timeout_msΪ~0ullʱʱûоcancelEventһЭ
+	//ʱʱFdContextǶĽڵ㣬ڴ档ֵͬaddEvent0ʱseqΪεȴţ
+	//Э̱ѺfinishWait
+	int waitEvent(int fd, Event event, uint64_t timeout_ms, uint32_t& seq);
+	//waitEventĵȴȡûеڵĳʱʱεȴΪʱʱtrue
+	bool finishWait(int fd, Event event, uint32_t seq);
 	bool delEvent(int fd, Event event);	
 	bool cancelEvent(int fd, Event event);
 	
 	bool cancelAll(int fd);
 	static IOManager* GetThis();
+	
+	bool isPerThreadEpoll() const { return m_perThread;}
+	bool isPersistentRegistration() const { return m_persistent;}
+	//epollʵÿ߳epollģʽµڹ߳Ϊ1
+	size_t getPollerCount() const { return m_perThread ? m_pollers.size() : 1;}
+	//fd󶨵Ĺ߳±꣬δ󶨻߲ÿ߳epollģʽʱ-1
+	int getFdPoller(int fd);
+	//fdǨƵpollerẒ́߳ע¼һǨƣ֮¼ִ߳Уڸƽ
+	//ÿ߳epollģʽ
+	bool migrateFd(int fd, size_t poller);
+	
+	//Ƿio_uring
+	bool hasIoUring() const { return m_uring != nullptr;}
+	//ύsqeǰЭֱɣresΪʧʱΪ-errnoʱΪ-ETIMEDOUT
+	//δio_uringǰЭʹùջгջϵĻᱻЭ̸ǣ߶ʱfalse
+	//Ӧ˵addEvent
+	bool submitIo(const io_uring_sqe& sqe, uint64_t timeout_ms, int& res);
+	//ȡfd;io_uring󣬱ȡresΪ-ECANCELED
+	void cancelIo(int fd);
+	
+	//tickle()õĴ
+	uint64_t getTickleRequested() const { return m_tickleRequested;}
+	//ʵдeventfd̵߳Ĵ
+	uint64_t getTickleSent() const { return m_tickleSent;}
+	//iomanager.busy_poll_usΪ0ʱæѯĴǰȵ¼Ĵ
+	uint64_t getBusyPollCount() const { return m_busyPolls;}
+	uint64_t getBusyPollHits() const { return m_busyPollHits;}
 
 protected:
 	void tickle() override;
+	void tickleThread(int thread) override;
   bool stopping() override;
 	void idle() override;
 	void onTimerInsertedAtFront() override;
+	int getTimerShard() override;
+	void onTimerShardNotify(int shard) override;
 	
-	void contextResize(size_t size);
 	bool stopping(uint64_t& timeout);
+private:
+	//fdӦFdContextֻԭӶ
+	//auto_createΪtrueʱڵĶκFdContextfd̵ļʱnullptr
+	FdContext* getFdContext(int fd, bool auto_create = false);
+	//fdǰעڵepollʵ
+	int getEpfd(FdContext* fd_ctx);
+	//¼ִЭ̵̣߳ÿ߳epollģʽΪfd󶨵̣߳Ϊ-1
+	int getEventThread(FdContext* fd_ctx);
+	//ռpoller˯߱ǲдeventfdɹtrue
+	bool wakePoller(Poller* poller);
+	//ѳfd_ctx->mutexɾevent¼
+	bool cancelEvent(FdContext* fd_ctx, Event event);
+	//waitEventĳʱصseqڵ㵱ǰŲͬ¼Ѿʱ
+	static void OnEventTimeout(TimerNode* node, uint32_t seq);
 private:
 	int m_epfd = 0;      //epollʾļ
-	int m_tickleFds[2];  //m_tickleFds[0]m_tickleFds[0]ֱΪܵ˺д˵ļ
+	int m_tickleFd = -1; //epoll_waiteventfd
+	//epoll_waitСһûб֪ͨ߳ÿдeventfdǰռһÿ˯౻һ
+	std::atomic<int> m_sleepingThreads = {0};
+	std::atomic<uint64_t> m_tickleRequested = {0};
+	std::atomic<uint64_t> m_tickleSent = {0};
+	std::atomic<uint64_t> m_busyPolls = {0};
+	std::atomic<uint64_t> m_busyPollHits = {0};
 	
 	std::atomic<size_t> m_pendingEventCount = {0};
-	RWMutexType m_mutex;
-	std::vector<FdContext*> m_fdContexts;
+	//fdһȰRLIMIT_NOFILEڹʱȷݣԲҲҪ
+	std::atomic<FdSegment*>* m_fdSegments = nullptr;
+	size_t m_fdSegmentCount = 0;
+	
+	bool m_perThread = false;
+	bool m_persistent = false;
+	std::vector<Poller*> m_pollers;				//ÿ߳epollģʽ¸̵߳epollʵ±Ϊ߳±
+	std::atomic<size_t> m_nextPoller = {0};	//ǹ߳עfdʱ
+	
+	IoUring* m_uring = nullptr;	//io_uringˣ֪ͨeventfdעm_epfd
+	//io_uringţΪuser_dataȡƥֵظʱȡ֮
+	std::atomic<uint64_t> m_ioRequestId = {0};
+	Spinlock m_ioMutex;
+	std::unordered_map<uint64_t, IoWaiter*> m_ioWaiters;	//;ŵȴ
 };	
 	
 }
@@ -1,10 +1,20 @@
 #include "log.h"
 #include<map>
+#include<unordered_map>
 #include<iostream>
 #include<functional>
 #include<time.h>
 #include<string.h>
+#include<errno.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<dirent.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<algorithm>
+#include<sched.h>
 #include"config.h"
+#include "binlog.h"
 
 namespace sylar{
 const char* LogLevel::ToString(LogLevel::Level level) {
@@ -48,13 +58,67 @@ const char* LogLevel::ToString(LogLevel::Level level) {
 	}
 	
 	LogEventWrap::LogEventWrap(LogEvent::ptr e) 
-		:m_event(e){
-		
+		:m_event(&m_owned)
+		,m_owned(std::move(e)) {
+	}
+
+	//ÿ̻߳¼־ݵĹٴ־ʱͬʱõ
+	static const size_t s_log_event_cache = 4;
+	struct LogEventSlot {
+		LogEvent::ptr event;
+		bool busy = false;
+	};
+	static thread_local LogEventSlot t_log_events[s_log_event_cache];
+
+	LogEventWrap::LogEventWrap(const std::shared_ptr<Logger>& logger, LogLevel::Level level
+			,const char* file, int32_t line, uint32_t elapse
+			,uint32_t thread_id, uint32_t fiber_id, uint64_t time
+			,const std::string& thread_name)
+		:m_event(&m_owned) {
+		for(size_t i = 0; i < s_log_event_cache; ++i) {
+			LogEventSlot& slot = t_log_events[i];
+			if(slot.busy) {
+				continue;
+			}
+			if(!slot.event) {
+				slot.event.reset(new LogEvent(logger, level, file, line, elapse
+							, thread_id, fiber_id, time, thread_name));
+			}
+			//appenderе¼ܸ
+			else if(slot.event.use_count() == 1) {
+				LogEvent* ev = slot.event.get();
+				ev->m_file = file;
+				ev->m_line = line;
+				ev->m_elapse = elapse;
+				ev->m_threadId = thread_id;
+				ev->m_fiberId = fiber_id;
+				ev->m_time = time;
+				ev->m_threadName = thread_name;
+				ev->m_logger = logger;
+				ev->m_level = level;
+				ev->m_ss.reset();
+			}
+			else {
+				continue;
+			}
+			slot.busy = true;
+			m_busy = &slot.busy;
+			m_event = &slot.event;
+			return;
+		}
+		m_owned.reset(new LogEvent(logger, level, file, line, elapse
+					, thread_id, fiber_id, time, thread_name));
 	}
 	
 	//Ϻ궨壬ʵʽ
 	LogEventWrap::~LogEventWrap() {
-		m_event->getLogger()->log(m_event->getLevel(), m_event);
+		const LogEvent::ptr& event = *m_event;
+		event->getLogger()->log(event->getLevel(), event);
+		if(m_busy) {
+			//¼¼һֱloggerloggerappender޷ʱ
+			event->m_logger.reset();
+			*m_busy = false;
+		}
 	}
 	
 	void LogEvent::format(const char* fmt, ...) {
@@ -65,138 +129,90 @@ const char* LogLevel::ToString(LogLevel::Level level) {
 	}
 	
 	void LogEvent::format(const char* fmt, va_list al) {
-		char* buf = nullptr;
-		int len = vasprintf(&buf, fmt, al);
-		if(len != -1) {
-			m_ss << std::string(buf, len);
-			free(buf);
-		}
+		m_ss.vformat(fmt, al);
 	}
 	
-	std::stringstream& LogEventWrap::getSS() {
-		return m_event->getSS();
+	LogStream& LogEventWrap::getSS() {
+		return (*m_event)->getSS();
+	}
+
+	//Сݻڸʱͷţżһ־ûһֱռڴ
+	static const size_t s_log_stream_keep = 64 * 1024;
+
+	void LogStream::Buffer::grow(size_t n) {
+		size_t used = size();
+		size_t cap = std::max(std::max(m_data.size() * 2, used + n), (size_t)256);
+		m_data.resize(cap);
+		setp(&m_data[0], &m_data[0] + cap);
+		pbump(used);
+	}
+
+	void LogStream::Buffer::reset() {
+		if(m_data.size() > s_log_stream_keep) {
+			std::vector<char>().swap(m_data);
+		}
+		if(m_data.empty()) {
+			setp(nullptr, nullptr);
+		}
+		else {
+			setp(&m_data[0], &m_data[0] + m_data.size());
+		}
+	}
+
+	LogStream::Buffer::int_type LogStream::Buffer::overflow(int_type c) {
+		if(traits_type::eq_int_type(c, traits_type::eof())) {
+			return traits_type::not_eof(c);
+		}
+		*reserve(1) = traits_type::to_char_type(c);
+		pbump(1);
+		return c;
+	}
+
+	std::streamsize LogStream::Buffer::xsputn(const char* s, std::streamsize n) {
+		memcpy(reserve(n), s, n);
+		pbump(n);
+		return n;
+	}
+
+	LogStream::LogStream()
+		:std::ostream(nullptr) {
+		rdbuf(&m_buf);
+	}
+
+	void LogStream::appendDecimal(uint64_t v, bool neg) {
+		char tmp[24];
+		char* p = tmp + sizeof(tmp);
+		do {
+			*--p = '0' + v % 10;
+			v /= 10;
+		} while(v);
+		if(neg) {
+			*--p = '-';
+		}
+		append(p, tmp + sizeof(tmp) - p);
+	}
+
+	void LogStream::reset() {
+		m_buf.reset();
+		clear();
+	}
+
+	void LogStream::vformat(const char* fmt, va_list al) {
+		va_list ap;
+		va_copy(ap, al);
+		char* buf = m_buf.reserve(128);
+		size_t avail = m_buf.available();
+		int len = vsnprintf(buf, avail, fmt, ap);
+		va_end(ap);
+		if(len < 0) {
+			return;
+		}
+		if((size_t)len >= avail) {
+			buf = m_buf.reserve(len + 1);
+			vsnprintf(buf, len + 1, fmt, al);
+		}
+		m_buf.commit(len);
 	}
-	
-	class MessageFormatItem : public LogFormatter::FormatItem {
-		public:
-			MessageFormatItem(const std::string& str = "") {}
-			void format(std::ostream& os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override{
-				os << event->getContent();
-			}
-	};
-	
-	class LevelFormatItem : public LogFormatter::FormatItem {
-		public:
-			LevelFormatItem(const std::string& str = "") {}
-			void format(std::ostream& os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override{
-				os << LogLevel::ToString(level);
-			}
-	};
-	
-	class ElapseFormatItem : public LogFormatter::FormatItem {
-		public:
-			ElapseFormatItem(const std::string& str = "") {}
-			void format(std::ostream& os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override{
-				os << event->getElapse();
-			}
-	};
-	
-	class NameFormatItem : public LogFormatter::FormatItem {
-		public:
-			NameFormatItem(const std::string& str = "") {}
-			void format(std::ostream& os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override{
-				os << event->getLogger()->getName();
-			}
-	};
-	
-	class ThreadIdFormatItem : public LogFormatter::FormatItem {
-		public:
-			ThreadIdFormatItem(const std::string& str = "") {}
-			void format(std::ostream& os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override{
-				os << event->getThreadId();
-			}
-	};
-	
-	class FiberIdFormatItem : public LogFormatter::FormatItem {
-		public:
-			FiberIdFormatItem(const std::string& str = "") {}
-			void format(std::ostream& os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override{
-				os << event->getFiberId();
-			}
-	};
-	
-	class ThreadNameFormatItem : public LogFormatter::FormatItem {
-		public:
-			ThreadNameFormatItem(const std::string& str = "") {}
-			void format(std::ostream& os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override{
-				os << event->getThreadName();
-			}
-	};
-	
-	class DateTimeFormatItem : public LogFormatter::FormatItem {
-		public:
-			DateTimeFormatItem(const std::string& format = "%Y-%m-%d %H:%M:%S")
-				:m_format(format) {
-					if(m_format.empty()) {
-						m_format = "%Y-%m-%d %H:%M:%S";
-					}
-				}
-			void format(std::ostream& os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override{
-				struct tm tm;
-				time_t time = event->getTime();
-				localtime_r(&time, &tm);
-				char buf[64];
-				strftime(buf, sizeof(buf), m_format.c_str(), &tm);
-				os << buf;
-			}
-		private:
-			std::string m_format;
-	};
-	
-	class FilenameFormatItem : public LogFormatter::FormatItem {
-		public:
-			FilenameFormatItem(const std::string& str = "") {}
-			void format(std::ostream& os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override{
-				os << event->getFile();
-			}
-	};
-	
-	class LineFormatItem : public LogFormatter::FormatItem {
-		public:
-			LineFormatItem(const std::string& str = "") {}
-			void format(std::ostream& os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override{
-				os << event->getLine();
-			}
-	};
-	
-	class StringFormatItem : public LogFormatter::FormatItem {
-		public:
-			StringFormatItem(const std::string& str)
-				:m_string(str) {}
-			void format(std::ostream& os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override{
-				os << m_string;
-			}
-		private:
-			std::string m_string;
-	};
-	
-	class NewLineFormatItem : public LogFormatter::FormatItem {
-		public:
-			NewLineFormatItem(const std::string& str = "") {}
-			void format(std::ostream& os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override{
-				os << std::endl;
-			}
-	};
-	
-	class TabFormatItem : public LogFormatter::FormatItem {
-		public:
-			TabFormatItem(const std::string& str = "") {}
-			void format(std::ostream& os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override{
-				os << "\t";
-			}
-		private:
-			std::string m_string;
-	};
 	
 	LogEvent::LogEvent(std::shared_ptr<Logger> logger, LogLevel::Level level
             ,const char* file, int32_t line, uint32_t elapse
@@ -212,11 +228,157 @@ const char* LogLevel::ToString(LogLevel::Level level) {
     ,m_logger(logger)
     ,m_level(level) {
 }
-	
+
+	//д־̵߳Ķʾڱĳloggerappenderб
+	struct LogReader {
+		std::atomic<uint64_t> seq = {0};
+	};
+
+	//̵߳Ķ̬ʱд־
+	struct LogReaderRegistry {
+		Mutex mutex;
+		std::vector<LogReader*> readers;
+	};
+
+	static LogReaderRegistry& GetReaderRegistry() {
+		static LogReaderRegistry* s_registry = new LogReaderRegistry;
+		return *s_registry;
+	}
+
+	//ǰ̵߳Ķ䣬һд־ʱעᣬ߳˳ʱע
+	//д־ʱֻ⼸ƽ͵߳˽б߳˽жĳʼ
+	static thread_local LogReader* t_log_reader = nullptr;
+	static thread_local uint32_t t_log_depth = 0;
+	static thread_local bool t_log_retired = false;
+	//߳˽ж֮󻹿־߳˽ж֮Ϊ
+	static thread_local bool t_log_reader_exited = false;
+
+	//߳˳ʱעԼڱ̶߳ڱ滻Ҫͷŵľб
+	struct LocalLogReader {
+		~LocalLogReader();
+		std::vector<const Logger::AppenderList*> retired;
+	};
+
+	static thread_local LocalLogReader t_local_log_reader;
+
+	static void FreeRetiredAppenders() {
+		for(auto i : t_local_log_reader.retired) {
+			delete i;
+		}
+		t_local_log_reader.retired.clear();
+		t_log_retired = false;
+	}
+
+	LocalLogReader::~LocalLogReader() {
+		t_log_reader_exited = true;
+		if(t_log_reader) {
+			LogReaderRegistry& r = GetReaderRegistry();
+			Mutex::Lock lock(r.mutex);
+			r.readers.erase(std::find(r.readers.begin(), r.readers.end(), t_log_reader));
+		}
+		delete t_log_reader;
+		t_log_reader = nullptr;
+		for(auto i : retired) {
+			delete i;
+		}
+		retired.clear();
+	}
+
+	static LogReader* RegisterLogReader() {
+		if(t_log_reader_exited) {
+			return nullptr;
+		}
+		//ȹ߳˽ж󣬱֤߳˳ʱע
+		t_local_log_reader.retired.reserve(1);
+		LogReader* reader = new LogReader;
+		{
+			LogReaderRegistry& r = GetReaderRegistry();
+			Mutex::Lock lock(r.mutex);
+			r.readers.push_back(reader);
+		}
+		t_log_reader = reader;
+		return reader;
+	}
+
+	//ȴڱб߳뿪ͷţʱܳlogger
+	static void RetireAppenders(const Logger::AppenderList* appenders) {
+		LogReader* self = t_log_reader;
+		{
+			LogReaderRegistry& r = GetReaderRegistry();
+			Mutex::Lock lock(r.mutex);
+			for(auto i : r.readers) {
+				if(i == self) {
+					continue;
+				}
+				//бѾseq_cstҪô߿бҪô￴ߵ
+				uint64_t seq = i->seq.load(std::memory_order_seq_cst);
+				if(!(seq & 1)) {
+					continue;
+				}
+				while(i->seq.load(std::memory_order_acquire) == seq) {
+					sched_yield();
+				}
+			}
+		}
+		if(self && t_log_depth) {
+			t_local_log_reader.retired.push_back(appenders);
+			t_log_retired = true;
+		}
+		else {
+			delete appenders;
+		}
+	}
+
+	//д־ڼʹõappenderбҲ޸ü
+	class Logger::AppenderSnapshot : Noncopyable {
+	public:
+		AppenderSnapshot(Logger* logger) {
+			LogReader* r = t_log_reader;
+			if(!r && !(r = RegisterLogReader())) {
+				m_mutex = &logger->m_mutex;
+				m_mutex->lock();
+				m_list = logger->m_appenders.load(std::memory_order_relaxed);
+				return;
+			}
+			m_reader = r;
+			if(t_log_depth++ == 0) {
+				r->seq.store(r->seq.load(std::memory_order_relaxed) + 1, std::memory_order_seq_cst);
+			}
+			m_list = logger->m_appenders.load(std::memory_order_seq_cst);
+		}
+		~AppenderSnapshot() {
+			if(m_mutex) {
+				m_mutex->unlock();
+				return;
+			}
+			if(--t_log_depth == 0) {
+				m_reader->seq.store(m_reader->seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+				if(t_log_retired) {
+					FreeRetiredAppenders();
+				}
+			}
+		}
+		const AppenderList& list() const { return *m_list;}
+	private:
+		const AppenderList* m_list = nullptr;
+		LogReader* m_reader = nullptr;
+		MutexType* m_mutex = nullptr;
+	};
+
 	Logger::Logger(const std::string& name) : m_name(name),
-		m_level(LogLevel::DEBUG) {
+		m_level(LogLevel::DEBUG),
+		m_appenders(new AppenderList) {
 		m_formatter.reset(new LogFormatter("%d{%Y-%m-%d %H:%M:%S}%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n"));
 	}
+
+	Logger::~Logger() {
+		//д־̳߳loggerãʱ߳ڱ
+		delete m_appenders.load(std::memory_order_relaxed);
+	}
+
+	const Logger::AppenderList* Logger::setAppenders(AppenderList* appenders) {
+		return m_appenders.exchange(appenders, std::memory_order_seq_cst);
+	}
 	
 		std::string Logger::toYamlString() {
 		MutexType::Lock lock(m_mutex);
@@ -229,7 +391,7 @@ const char* LogLevel::ToString(LogLevel::Level level) {
 			node["formatter"] = m_formatter->getPattern();
 		}
 		
-		for(auto& i : m_appenders) {
+		for(auto& i : *m_appenders.load(std::memory_order_relaxed)) {
 			node["appenders"].push_back(YAML::Load(i->toYamlString()));
 		}
 		std::stringstream ss;
@@ -241,7 +403,7 @@ const char* LogLevel::ToString(LogLevel::Level level) {
 		MutexType::Lock lock(m_mutex);
 		m_formatter = val;
 		
-		for(auto& i : m_appenders) {
+		for(auto& i : *m_appenders.load(std::memory_order_relaxed)) {
 			MutexType::Lock ll(i->m_mutex);
 			if(!i->m_hasFormatter) {
 				i->m_formatter = m_formatter;
@@ -266,36 +428,64 @@ const char* LogLevel::ToString(LogLevel::Level level) {
 	}
 	
 	void Logger::addAppender(LogAppender::ptr appender) {
-		MutexType::Lock lock(m_mutex);
-		if(!appender->getFormatter()) {
-			MutexType::Lock ll(appender->m_mutex);
-			appender->m_formatter = m_formatter;
+		const AppenderList* old = nullptr;
+		{
+			MutexType::Lock lock(m_mutex);
+			if(!appender->getFormatter()) {
+				MutexType::Lock ll(appender->m_mutex);
+				appender->m_formatter = m_formatter;
+			}
+			AppenderList* appenders = new AppenderList(*m_appenders.load(std::memory_order_relaxed));
+			appenders->push_back(appender);
+			old = setAppenders(appenders);
 		}
-		m_appenders.push_back(appender);
+		RetireAppenders(old);
 	}
 	void Logger::delAppender(LogAppender::ptr appender) {
-		MutexType::Lock lock(m_mutex);
-		for(auto it = m_appenders.begin();
-			it != m_appenders.end(); ++it) {
-				if(*it == appender) {
-					m_appenders.erase(it);
-					break;
+		const AppenderList* old = nullptr;
+		{
+			MutexType::Lock lock(m_mutex);
+			const AppenderList* cur = m_appenders.load(std::memory_order_relaxed);
+			for(auto it = cur->begin();
+				it != cur->end(); ++it) {
+					if(*it == appender) {
+						AppenderList* appenders = new AppenderList(*cur);
+						appenders->erase(appenders->begin() + (it - cur->begin()));
+						old = setAppenders(appenders);
+						break;
+					}
 				}
-			}
+		}
+		if(old) {
+			RetireAppenders(old);
+		}
 	}
 	
 	void Logger::clearAppenders() {
-		MutexType::Lock lock(m_mutex);
-		m_appenders.clear();
+		const AppenderList* old = nullptr;
+		{
+			MutexType::Lock lock(m_mutex);
+			old = setAppenders(new AppenderList);
+		}
+		RetireAppenders(old);
 	}
 	
-	void Logger::log(LogLevel::Level level, LogEvent::ptr event) {
+	void Logger::log(LogLevel::Level level, const LogEvent::ptr& event) {
 		if(level >= m_level) {
-			auto self = shared_from_this();
-			MutexType::Lock lock(m_mutex);
-			if(!m_appenders.empty()) {
-				for(auto& i : m_appenders) {
-					i->log(self, level, event);
+			AppenderSnapshot snapshot(this);
+			const AppenderList& appenders = snapshot.list();
+			if(!appenders.empty()) {
+				//¼ɱloggerʱֱʹ¼еãʡshared_from_thisü
+				if(event->getLogger().get() == this) {
+					for(auto& i : appenders) {
+						i->log(event->getLogger(), level, event);
+					}
+				}
+				else {
+					auto self = shared_from_this();
+					for(auto& i : appenders) {
+						i->log(self, level, event);
+					}
 				}
 			}
 			else if(m_root) {
@@ -303,6 +493,43 @@ const char* LogLevel::ToString(LogLevel::Level level) {
 			}
 		}
 	}
+	void Logger::logBinary(const Logger::ptr& source, LogLevel::Level level, const char* data, size_t len) {
+		if(level >= m_level) {
+			AppenderSnapshot snapshot(this);
+			const AppenderList& appenders = snapshot.list();
+			if(!appenders.empty()) {
+				for(auto& i : appenders) {
+					i->logBinary(source, level, data, len);
+				}
+			}
+			else if(m_root) {
+				m_root->logBinary(source, level, data, len);
+			}
+		}
+	}
+
+	void LogAppender::logBinary(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const char* data, size_t len) {
+		if(level < m_level) {
+			return;
+		}
+		uint8_t type = 0;
+		const char* payload = nullptr;
+		size_t payload_len = 0;
+		BinaryLog::Event ev;
+		if(BinaryLog::ReadRecord(data, len, type, payload, payload_len) <= 0 || type != BinaryLog::EVENT
+				|| !BinaryLog::ParseEvent(type, payload, payload_len, ev)) {
+			return;
+		}
+		const BinaryLog::Format* fmt = BinaryLog::GetFormat(ev.id);
+		if(!fmt) {
+			return;
+		}
+		LogEvent::ptr event(new LogEvent(logger, level, fmt->file.c_str(), fmt->line, 0, ev.threadId
+					, ev.fiberId, GetCoarseTime(), Thread::GetName()));
+		BinaryLog::FormatMessage(event->getSS(), fmt->fmt, fmt->types, ev.args, ev.argsLen);
+		log(logger, level, event);
+	}
+
 	void Logger::debug(LogEvent::ptr event) {
 		log(LogLevel::DEBUG, event);
 	}
@@ -322,15 +549,25 @@ const char* LogLevel::ToString(LogLevel::Level level) {
 	FileLogAppender::FileLogAppender(const std::string& filename) : m_filename(filename) {
 		reopen();
 	}
-	void FileLogAppender::log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) {
+	//appenderʽ߳˽еĻֻһ
+	static LogStream& GetFormatStream() {
+		static thread_local LogStream t_stream;
+		t_stream.reset();
+		return t_stream;
+	}
+
+	void FileLogAppender::log(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) {
 		if(level >= m_level) {
 			//uint64_t now = time(0);
 			//if(now != m_lastTime) {
 			//	reopen();
 			//	m_lastTime = now;
 			//}
+			LogStream& ss = GetFormatStream();
+			getFormatter()->format(ss, logger, level, event);
 			MutexType::Lock lock(m_mutex);
-			m_filestream << m_formatter->format(logger, level, event);
+			m_filestream.write(ss.data(), ss.size());
+			m_filestream.flush();
 		}
 	}
 	
@@ -375,14 +612,570 @@ const char* LogLevel::ToString(LogLevel::Level level) {
 		return !!m_filestream;
 	}
 	
-	void StdoutLogAppender::log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) {
+	void StdoutLogAppender::log(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) {
 		if(level >= m_level) {
+			LogStream& ss = GetFormatStream();
+			getFormatter()->format(ss, logger, level, event);
 			MutexType::Lock lock(m_mutex);
-			std::cout << m_formatter->format(logger, level, event);
+			std::cout.write(ss.data(), ss.size());
+			std::cout.flush();
+		}
+	}
+	const char* AsyncLogAppender::OverflowToString(Overflow v) {
+		switch(v) {
+			case BLOCK:
+				return "block";
+			case SAMPLE:
+				return "sample";
+			default:
+				return "drop";
+		}
+	}
+
+	AsyncLogAppender::Overflow AsyncLogAppender::OverflowFromString(const std::string& str) {
+		if(str == "block") {
+			return BLOCK;
+		}
+		if(str == "sample") {
+			return SAMPLE;
+		}
+		return DROP;
+	}
+
+	AsyncLogAppender::AsyncLogAppender(const std::string& filename, size_t buffer_size
+			, size_t max_buffers, Overflow overflow, uint32_t flush_interval, uint32_t sample_rate)
+		:m_filename(filename)
+		,m_bufferSize(std::max(buffer_size, (size_t)4096))
+		,m_maxBuffers(std::max(max_buffers, (size_t)1))
+		,m_overflow(overflow)
+		,m_flushInterval(std::max(flush_interval, (uint32_t)1))
+		,m_sampleRate(std::max(sample_rate, (uint32_t)1)) {
+		m_current = new Buffer(m_bufferSize);
+		reopen();
+		m_thread.reset(new Thread(std::bind(&AsyncLogAppender::run, this), "log_async"));
+	}
+
+	AsyncLogAppender::~AsyncLogAppender() {
+		stop();
+		delete m_current;
+		for(auto i : m_full) {
+			delete i;
+		}
+		for(auto i : m_spare) {
+			delete i;
+		}
+		if(m_fd > STDERR_FILENO) {
+			close(m_fd);
+		}
+	}
+
+	bool AsyncLogAppender::reopen() {
+		if(m_filename.empty()) {
+			m_fd = STDOUT_FILENO;
+			++m_generation;
+			return true;
+		}
+		int fd = open(m_filename.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+		if(fd < 0) {
+			std::cout << "AsyncLogAppender open " << m_filename << " errno=" << errno
+				<< " errstr=" << strerror(errno) << std::endl;
+			return false;
+		}
+		if(m_fd < 0) {
+			m_fd = fd;
+			++m_generation;
+			return true;
+		}
+		//̨߳̿дdup2ԭӵذѾfdָļҪ
+		dup2(fd, m_fd);
+		close(fd);
+		++m_generation;
+		return true;
+	}
+
+	void AsyncLogAppender::stop() {
+		{
+			Spinlock::Lock lock(m_bufMutex);
+			if(m_stopping) {
+				return;
+			}
+			m_stopping = true;
+			for(; m_waiters; --m_waiters) {
+				m_space.notify();
+			}
+		}
+		m_notify.notify();
+		m_thread->join();
+	}
+
+	void AsyncLogAppender::log(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) {
+		if(level >= m_level) {
+			LogStream& ss = GetFormatStream();
+			getFormatter()->format(ss, logger, level, event);
+			append(level, ss.data(), ss.size());
 		}
 	}
+
+	bool AsyncLogAppender::append(LogLevel::Level level, const char* msg, size_t len) {
+		//һС־ض
+		len = std::min(len, m_bufferSize);
+		bool overflowed = false;
+		Spinlock::Lock lock(m_bufMutex);
+		while(true) {
+			if(m_stopping) {
+				++m_dropped;
+				return false;
+			}
+			if(m_current->size + len <= m_bufferSize) {
+				memcpy(m_current->data + m_current->size, msg, len);
+				m_current->size += len;
+				return true;
+			}
+			if(m_full.size() < m_maxBuffers) {
+				m_full.push_back(m_current);
+				if(!m_spare.empty()) {
+					m_current = m_spare.back();
+					m_spare.pop_back();
+				}
+				else {
+					m_current = new Buffer(m_bufferSize);
+				}
+				//̨߳дһ֮ŻȡֻڴӿձΪǿʱ
+				if(m_full.size() == 1) {
+					m_notify.notify();
+				}
+				continue;
+			}
+			//ѹÿ־ֻжһǷ
+			if(!overflowed) {
+				overflowed = true;
+				if(m_overflow == DROP
+						|| (m_overflow == SAMPLE && m_overflowCount++ % m_sampleRate != 0)) {
+					++m_dropped;
+					return false;
+				}
+				++m_blocked;
+			}
+			++m_waiters;
+			lock.unlock();
+			m_space.wait();
+			lock.lock();
+		}
+	}
+
+	void AsyncLogAppender::run() {
+		std::vector<Buffer*> buffers;
+		while(true) {
+			m_notify.waitFor(m_flushInterval);
+			bool stopping = false;
+			{
+				Spinlock::Lock lock(m_bufMutex);
+				if(m_current->size) {
+					m_full.push_back(m_current);
+					if(!m_spare.empty()) {
+						m_current = m_spare.back();
+						m_spare.pop_back();
+					}
+					else {
+						m_current = new Buffer(m_bufferSize);
+					}
+				}
+				buffers.swap(m_full);
+				stopping = m_stopping;
+			}
+			if(!buffers.empty()) {
+				beforeWrite();
+			}
+			writeAll(buffers);
+			{
+				Spinlock::Lock lock(m_bufMutex);
+				for(auto i : buffers) {
+					i->size = 0;
+					m_spare.push_back(i);
+				}
+				//дẒ̇߳max_buffers + 1
+				for(; m_waiters; --m_waiters) {
+					m_space.notify();
+				}
+			}
+			buffers.clear();
+			if(stopping) {
+				break;
+			}
+		}
+	}
+
+	void AsyncLogAppender::writeAll(const std::vector<Buffer*>& buffers) {
+		for(auto i : buffers) {
+			writeData(i->data, i->size);
+		}
+	}
+
+	void AsyncLogAppender::writeData(const char* data, size_t len) {
+		if(m_fd < 0) {
+			return;
+		}
+		size_t offset = 0;
+		while(offset < len) {
+			ssize_t rt = ::write(m_fd, data + offset, len - offset);
+			if(rt < 0) {
+				if(errno == EINTR) {
+					continue;
+				}
+				break;
+			}
+			offset += rt;
+		}
+	}
+
+	std::string AsyncLogAppender::toYamlString() {
+		MutexType::Lock lock(m_mutex);
+		YAML::Node node;
+		node["type"] = "AsyncLogAppender";
+		if(!m_filename.empty()) {
+			node["file"] = m_filename;
+		}
+		node["overflow"] = OverflowToString(m_overflow);
+		node["buffer_size"] = m_bufferSize;
+		node["max_buffers"] = m_maxBuffers;
+		node["flush_interval"] = m_flushInterval;
+		if(m_overflow == SAMPLE) {
+			node["sample_rate"] = m_sampleRate;
+		}
+		if(m_level != LogLevel::UNKNOW) {
+			node["level"] = LogLevel::ToString(m_level);
+		}
+		if(m_hasFormatter && m_formatter) {
+			node["formatter"] = m_formatter->getPattern();
+		}
+		std::stringstream ss;
+		ss << node;
+		return ss.str();
+	}
+
+	static std::atomic<uint64_t> s_formatter_id = {0};
+
+	RollingFileLogAppender::RollingFileLogAppender(const std::string& filename, size_t max_size
+			, uint32_t roll_interval, uint32_t max_files, uint32_t flush_interval)
+		:m_filename(filename)
+		,m_maxSize(std::max(max_size, (size_t)64 * 1024))
+		,m_rollInterval(roll_interval)
+		,m_maxFiles(max_files)
+		,m_flushInterval(std::max(flush_interval, (uint32_t)1)) {
+		//ϴµļȹ鵵쳣˳ʱļĩβܻԤĿհ
+		struct stat st;
+		if(stat(m_filename.c_str(), &st) == 0 && st.st_size > 0) {
+			int fd = open(m_filename.c_str(), O_RDWR | O_CLOEXEC);
+			if(fd >= 0) {
+				void* base = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+				if(base != MAP_FAILED) {
+					const char* data = (const char*)base;
+					size_t size = st.st_size;
+					while(size > 0 && data[size - 1] == 0) {
+						--size;
+					}
+					munmap(base, st.st_size);
+					if(ftruncate(fd, size)) {
+						std::cout << "RollingFileLogAppender ftruncate " << m_filename << " errno=" << errno
+							<< " errstr=" << strerror(errno) << std::endl;
+					}
+				}
+				close(fd);
+			}
+			MappedFile old;
+			old.path = m_filename;
+			archive(&old);
+		}
+		//ϴԤȴûõļ
+		std::vector<std::string> files;
+		listFiles(files, true);
+		for(auto& i : files) {
+			unlink(i.c_str());
+		}
+		m_current = openFile(m_filename);
+		m_rollTime = nextRollTime(time(0));
+		m_thread.reset(new Thread(std::bind(&RollingFileLogAppender::run, this), "log_rolling"));
+	}
+
+	RollingFileLogAppender::~RollingFileLogAppender() {
+		stop();
+		for(auto i : m_retired) {
+			closeFile(i);
+			archive(i);
+			delete i;
+		}
+		if(m_current) {
+			closeFile(m_current);
+			if(m_current->path != m_filename) {
+				rename(m_current->path.c_str(), m_filename.c_str());
+			}
+			delete m_current;
+		}
+		if(m_next) {
+			closeFile(m_next);
+			unlink(m_next->path.c_str());
+			delete m_next;
+		}
+	}
+
+	void RollingFileLogAppender::stop() {
+		{
+			Spinlock::Lock lock(m_fileMutex);
+			if(m_stopping) {
+				return;
+			}
+			m_stopping = true;
+		}
+		m_notify.notify();
+		m_thread->join();
+	}
+
+	RollingFileLogAppender::MappedFile* RollingFileLogAppender::openFile(const std::string& path) {
+		int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if(fd < 0) {
+			std::cout << "RollingFileLogAppender open " << path << " errno=" << errno
+				<< " errstr=" << strerror(errno) << std::endl;
+			return nullptr;
+		}
+		//Ԥȷ̿ռ䣬дӳʱΪյSIGBUS
+		int rt = posix_fallocate(fd, 0, m_maxSize);
+		if(rt) {
+			std::cout << "RollingFileLogAppender fallocate " << path << " size=" << m_maxSize
+				<< " rt=" << rt << " errstr=" << strerror(rt) << std::endl;
+			close(fd);
+			unlink(path.c_str());
+			return nullptr;
+		}
+		void* base = mmap(nullptr, m_maxSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if(base == MAP_FAILED) {
+			std::cout << "RollingFileLogAppender mmap " << path << " errno=" << errno
+				<< " errstr=" << strerror(errno) << std::endl;
+			close(fd);
+			unlink(path.c_str());
+			return nullptr;
+		}
+		MappedFile* file = new MappedFile;
+		file->path = path;
+		file->fd = fd;
+		file->base = (char*)base;
+		file->cap = m_maxSize;
+		return file;
+	}
+
+	void RollingFileLogAppender::closeFile(MappedFile* file) {
+		if(!file->base) {
+			return;
+		}
+		msync(file->base, file->size, MS_SYNC);
+		munmap(file->base, file->cap);
+		file->base = nullptr;
+		if(ftruncate(file->fd, file->size)) {
+			std::cout << "RollingFileLogAppender ftruncate " << file->path << " errno=" << errno
+				<< " errstr=" << strerror(errno) << std::endl;
+		}
+		close(file->fd);
+		file->fd = -1;
+	}
+
+	void RollingFileLogAppender::archive(MappedFile* file) {
+		struct tm tm;
+		time_t now = time(0);
+		localtime_r(&now, &tm);
+		char buf[32];
+		strftime(buf, sizeof(buf), "%Y%m%d-%H%M%S", &tm);
+		std::string name = m_filename + "." + buf;
+		//ͬһڶιʱ
+		std::string path = name;
+		for(int i = 1; access(path.c_str(), F_OK) == 0; ++i) {
+			path = name + "." + std::to_string(i);
+		}
+		if(rename(file->path.c_str(), path.c_str())) {
+			std::cout << "RollingFileLogAppender rename " << file->path << " to " << path
+				<< " errno=" << errno << " errstr=" << strerror(errno) << std::endl;
+		}
+	}
+
+	void RollingFileLogAppender::listFiles(std::vector<std::string>& files, bool next) {
+		std::string dir = ".";
+		std::string prefix = m_filename;
+		size_t pos = m_filename.rfind('/');
+		if(pos != std::string::npos) {
+			dir = pos ? m_filename.substr(0, pos) : "/";
+			prefix = m_filename.substr(pos + 1);
+		}
+		prefix += ".";
+		DIR* d = opendir(dir.c_str());
+		if(!d) {
+			return;
+		}
+		std::string next_prefix = prefix + "next.";
+		while(struct dirent* ent = readdir(d)) {
+			std::string name = ent->d_name;
+			if(name.size() <= prefix.size() || name.compare(0, prefix.size(), prefix) != 0) {
+				continue;
+			}
+			bool is_next = name.compare(0, next_prefix.size(), next_prefix) == 0;
+			if(is_next == next) {
+				files.push_back(dir + "/" + name);
+			}
+		}
+		closedir(d);
+		//鵵ļʱ԰ַ
+		std::sort(files.begin(), files.end());
+	}
+
+	void RollingFileLogAppender::removeExpired() {
+		if(!m_maxFiles) {
+			return;
+		}
+		std::vector<std::string> files;
+		listFiles(files, false);
+		for(size_t i = 0; i + m_maxFiles < files.size(); ++i) {
+			unlink(files[i].c_str());
+		}
+	}
+
+	uint64_t RollingFileLogAppender::nextRollTime(uint64_t now) const {
+		if(!m_rollInterval) {
+			return (uint64_t)-1;
+		}
+		//ʱ룬86400ÿ
+		struct tm tm;
+		time_t t = now;
+		localtime_r(&t, &tm);
+		int64_t offset = tm.tm_gmtoff;
+		return ((now + offset) / m_rollInterval + 1) * m_rollInterval - offset;
+	}
+
+	void RollingFileLogAppender::log(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) {
+		if(level >= m_level) {
+			LogStream& ss = GetFormatStream();
+			getFormatter()->format(ss, logger, level, event);
+			append(ss.data(), ss.size(), event->getTime());
+		}
+	}
+
+	bool RollingFileLogAppender::append(const char* msg, size_t len, uint64_t time) {
+		len = std::min(len, m_maxSize);
+		bool ok = false;
+		bool notify = false;
+		{
+			Spinlock::Lock lock(m_fileMutex);
+			if(m_stopping) {
+				++m_dropped;
+				return false;
+			}
+			MappedFile* cur = m_current;
+			bool roll = !cur || cur->size + len > cur->cap;
+			if(time >= m_rollTime) {
+				if(cur && cur->size == 0) {
+					m_rollTime = nextRollTime(time);
+				}
+				else {
+					roll = true;
+				}
+			}
+			//һļû׼ʱʱƳ٣дļֻܶ
+			if(roll && m_next) {
+				if(cur) {
+					m_retired.push_back(cur);
+				}
+				m_current = cur = m_next;
+				m_next = nullptr;
+				m_rollTime = nextRollTime(time);
+				notify = true;
+			}
+			if(cur && cur->size + len <= cur->cap) {
+				memcpy(cur->base + cur->size, msg, len);
+				cur->size += len;
+				ok = true;
+			}
+			else {
+				++m_dropped;
+				notify = true;
+			}
+		}
+		if(notify) {
+			m_notify.notify();
+		}
+		return ok;
+	}
+
+	void RollingFileLogAppender::run() {
+		static const size_t s_page_size = sysconf(_SC_PAGESIZE);
+		while(true) {
+			m_notify.waitFor(m_flushInterval);
+			std::vector<MappedFile*> retired;
+			MappedFile* current = nullptr;
+			size_t size = 0;
+			bool need_next = false;
+			bool stopping = false;
+			{
+				Spinlock::Lock lock(m_fileMutex);
+				retired.swap(m_retired);
+				current = m_current;
+				size = current ? current->size : 0;
+				need_next = !m_next;
+				stopping = m_stopping;
+			}
+			//׼һļд־ֻ߳̿ܺܿдǰļ
+			if(need_next && !stopping) {
+				MappedFile* next = openFile(m_filename + ".next." + std::to_string(++m_nextSeq));
+				if(next) {
+					Spinlock::Lock lock(m_fileMutex);
+					m_next = next;
+				}
+			}
+			for(auto i : retired) {
+				closeFile(i);
+				archive(i);
+				delete i;
+				++m_rolls;
+			}
+			//лļ֮ǰ׼.nextļļ鵵֮Ļʽļ
+			if(current && current->path != m_filename) {
+				if(rename(current->path.c_str(), m_filename.c_str()) == 0) {
+					current->path = m_filename;
+				}
+			}
+			if(!retired.empty()) {
+				removeExpired();
+			}
+			//msyncдĲֻ̨֣߳
+			if(current && size > current->synced) {
+				size_t begin = current->synced & ~(s_page_size - 1);
+				msync(current->base + begin, size - begin, MS_SYNC);
+				current->synced = size;
+			}
+			if(stopping) {
+				break;
+			}
+		}
+	}
+
+	std::string RollingFileLogAppender::toYamlString() {
+		MutexType::Lock lock(m_mutex);
+		YAML::Node node;
+		node["type"] = "RollingFileLogAppender";
+		node["file"] = m_filename;
+		node["max_size"] = m_maxSize;
+		node["roll_interval"] = m_rollInterval;
+		node["max_files"] = m_maxFiles;
+		node["flush_interval"] = m_flushInterval;
+		if(m_level != LogLevel::UNKNOW) {
+			node["level"] = LogLevel::ToString(m_level);
+		}
+		if(m_hasFormatter && m_formatter) {
+			node["formatter"] = m_formatter->getPattern();
+		}
+		std::stringstream ss;
+		ss << node;
+		return ss.str();
+	}
+
 	LogFormatter::LogFormatter (const std::string& pattern)
-		:m_pattern(pattern) {
+		:m_pattern(pattern)
+		,m_id(++s_formatter_id) {
 		init();
 	}
 	
@@ -402,12 +1195,123 @@ const char* LogLevel::ToString(LogLevel::Level level) {
 	}
 	
 	//õ־¼
-	std::string LogFormatter::format(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) {
-		std::stringstream ss;
-			for(auto& i : m_items) {
-				i->format(ss, logger, level, event);
+	std::string LogFormatter::format(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) {
+		LogStream ss;
+		format(ss, logger, level, event);
+		return ss.str();
+	}
+
+	std::ostream& LogFormatter::format(std::ostream& os, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) {
+		run(os, level, event);
+		return os;
+	}
+
+	LogStream& LogFormatter::format(LogStream& os, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) {
+		run(os, level, event);
+		return os;
+	}
+
+	static inline void WriteTo(std::ostream& os, const char* str, size_t len) {
+		os.write(str, len);
+	}
+
+	static inline void WriteTo(LogStream& os, const char* str, size_t len) {
+		os.append(str, len);
+	}
+
+	static inline void WriteNewLine(std::ostream& os) {
+		os << std::endl;
+	}
+
+	static inline void WriteNewLine(LogStream& os) {
+		os.append("\n", 1);
+	}
+
+	template<class Stream>
+	void LogFormatter::run(Stream& os, LogLevel::Level level, const LogEvent::ptr& event) {
+		const LogEvent& ev = *event;
+		for(auto& op : m_ops) {
+			switch(op.code) {
+				case OP_STRING:
+					WriteTo(os, op.str.c_str(), op.str.size());
+					break;
+				case OP_MESSAGE:
+					WriteTo(os, ev.getStream().data(), ev.getStream().size());
+					break;
+				case OP_LEVEL:
+					os << LogLevel::ToString(level);
+					break;
+				case OP_ELAPSE:
+					os << ev.getElapse();
+					break;
+				case OP_NAME:
+					os << ev.getLogger()->getName();
+					break;
+				case OP_THREAD_ID:
+					os << ev.getThreadId();
+					break;
+				case OP_NEWLINE:
+					WriteNewLine(os);
+					break;
+				case OP_DATETIME: {
+					const char* str = nullptr;
+					size_t len = 0;
+					formatTime(op, ev.getTime(), str, len);
+					WriteTo(os, str, len);
+					break;
+				}
+				case OP_FILENAME:
+					os << ev.getFile();
+					break;
+				case OP_LINE:
+					os << ev.getLine();
+					break;
+				case OP_FIBER_ID:
+					os << ev.getFiberId();
+					break;
+				case OP_THREAD_NAME:
+					os << ev.getThreadName();
+					break;
 			}
-			return ss.str();
+		}
+	}
+
+	//ʱ仺水formatterźͲ±ֱӳ䣬ͻʱ
+	static const size_t s_time_cache_size = 8;
+	struct LogTimeCache {
+		uint64_t key = 0;
+		uint64_t time = 0;
+		size_t len = 0;
+		char buf[64];
+	};
+	static thread_local LogTimeCache t_time_cache[s_time_cache_size];
+
+	void LogFormatter::formatTime(const Op& op, uint64_t time, const char*& str, size_t& len) {
+		uint64_t index = &op - &m_ops[0];
+		uint64_t key = (m_id << 16) | index;
+		LogTimeCache& cache = t_time_cache[(m_id * 31 + index) % s_time_cache_size];
+		if(cache.key != key || cache.time != time) {
+			struct tm tm;
+			time_t t = time;
+			localtime_r(&t, &tm);
+			cache.len = strftime(cache.buf, sizeof(cache.buf), op.str.c_str(), &tm);
+			cache.key = key;
+			cache.time = time;
+		}
+		str = cache.buf;
+		len = cache.len;
+	}
+
+	void LogFormatter::addOp(OpCode code, const std::string& str) {
+		//ڵַϲ
+		if(code == OP_STRING && !m_ops.empty() && m_ops.back().code == OP_STRING) {
+			m_ops.back().str += str;
+			return;
+		}
+		Op op;
+		op.code = code;
+		op.str = str;
+		m_ops.push_back(op);
 	}
 	
 	//%xxx %xxx{xxx} %%
@@ -485,42 +1389,49 @@ const char* LogLevel::ToString(LogLevel::Level level) {
 		if(!nstr.empty()) {
 			vec.push_back(std::make_tuple(nstr, "", 0));
 		}
-		static std::map<std::string, std::function<FormatItem::ptr(const std::string& str)> > s_format_items = { //map洢<string, function>
+		static std::map<std::string, OpCode> s_format_ops = {
 #define XX(str, C) \
-        {#str, [](const std::string& fmt) { return FormatItem::ptr(new C(fmt));}} //lambdaʽ
-
-        XX(m, MessageFormatItem),           //m:Ϣ
-        XX(p, LevelFormatItem),             //p:־
-        XX(r, ElapseFormatItem),            //r:ۼƺ
-        XX(c, NameFormatItem),              //c:־
-        XX(t, ThreadIdFormatItem),          //t:߳id
-        XX(n, NewLineFormatItem),           //n:
-        XX(d, DateTimeFormatItem),          //d:ʱ
-        XX(f, FilenameFormatItem),          //f:ļ
-        XX(l, LineFormatItem),              //l:к
-        XX(T, TabFormatItem), 
-        XX(F, FiberIdFormatItem), 
-        XX(N, ThreadNameFormatItem),
+        {#str, C}
+
+        XX(m, OP_MESSAGE),           //m:Ϣ
+        XX(p, OP_LEVEL),             //p:־
+        XX(r, OP_ELAPSE),            //r:ۼƺ
+        XX(c, OP_NAME),              //c:־
+        XX(t, OP_THREAD_ID),         //t:߳id
+        XX(n, OP_NEWLINE),           //n:
+        XX(d, OP_DATETIME),          //d:ʱ
+        XX(f, OP_FILENAME),          //f:ļ
+        XX(l, OP_LINE),              //l:к
+        XX(T, OP_STRING),            //T:Ʊ
+        XX(F, OP_FIBER_ID),          //F:Эid
+        XX(N, OP_THREAD_NAME),       //N:߳
 #undef XX
     }; 
 		
+		m_ops.clear();
 		for(auto& i : vec) {
 			if(std::get<2>(i) == 0) {
-				m_items.push_back(FormatItem::ptr(new StringFormatItem(std::get<0>(i))));
+				addOp(OP_STRING, std::get<0>(i));
 			}
 			else {
-				auto it = s_format_items.find(std::get<0>(i));
-				if(it == s_format_items.end()) {
-					m_items.push_back(FormatItem::ptr(new StringFormatItem("<<error_format %" + std::get<0>(i) + ">>")));
+				auto it = s_format_ops.find(std::get<0>(i));
+				if(it == s_format_ops.end()) {
+					addOp(OP_STRING, "<<error_format %" + std::get<0>(i) + ">>");
 					m_error = true;
 				}
+				else if(std::get<0>(i) == "T") {
+					addOp(OP_STRING, "\t");
+				}
+				else if(it->second == OP_DATETIME) {
+					addOp(OP_DATETIME, std::get<1>(i).empty() ? "%Y-%m-%d %H:%M:%S" : std::get<1>(i));
+				}
 				else {
-					m_items.push_back(it->second(std::get<1>(i)));
+					addOp(it->second);
 				}
 			}
 			//std::cout << "(" << std::get<0>(i) << ") - (" << std::get<1>(i) << ") - (" << std::get<2>(i) << ")" <<  std::endl;
 		}
-		//std::cout << m_items.size() << std::endl;
+		//std::cout << m_ops.size() << std::endl;
 	}
 	
 	LoggerManager::LoggerManager() {
@@ -531,29 +1442,80 @@ const char* LogLevel::ToString(LogLevel::Level level) {
 		init();
 	}
 	
+	//߳˽еƵloggerĻ棬loggerLoggerManagerɾ治ҪʧЧ
+	struct LoggerCache {
+		~LoggerCache();
+		const LoggerManager* owner = nullptr;
+		std::unordered_map<std::string, Logger::ptr> loggers;
+	};
+
+	static thread_local LoggerCache t_logger_cache;
+	static thread_local bool t_logger_cache_destroyed = false;
+
+	LoggerCache::~LoggerCache() {
+		t_logger_cache_destroyed = true;
+	}
+
 	Logger::ptr LoggerManager::getLogger(const std::string& name) {
-		MutexType::Lock lock(m_mutex);
-		auto it = m_loggers.find(name);
-		if(it != m_loggers.end()) {
-			return it->second;
+		LoggerCache* cache = t_logger_cache_destroyed ? nullptr : &t_logger_cache;
+		if(cache && cache->owner == this) {
+			auto it = cache->loggers.find(name);
+			if(it != cache->loggers.end()) {
+				return it->second;
+			}
+		}
+		Logger::ptr logger;
+		{
+			MutexType::Lock lock(m_mutex);
+			auto it = m_loggers.find(name);
+			if(it != m_loggers.end()) {
+				logger = it->second;
+			}
+			else {
+				logger.reset(new Logger(name));
+				logger->m_root = m_root;
+				m_loggers[name] = logger;
+			}
+		}
+		if(cache) {
+			if(cache->owner != this) {
+				cache->loggers.clear();
+				cache->owner = this;
+			}
+			cache->loggers[name] = logger;
 		}
-		Logger::ptr logger(new Logger(name));
-		logger->m_root = m_root;
-		m_loggers[name] = logger;
 		return logger;
 	}
 	
 	struct LogAppenderDefine {
-		int type = 0; //1 File, 2 Stdout
+		int type = 0; //1 File, 2 Stdout, 3 Async, 4 Rolling, 5 Binary
 		LogLevel::Level level = LogLevel::UNKNOW;
 		std::string formatter;
 		std::string file;
+		//AsyncLogAppenderBinaryLogAppender
+		std::string overflow = "drop";
+		size_t buffer_size = 4 * 1024 * 1024;
+		size_t max_buffers = 16;
+		uint32_t flush_interval = 1000;
+		uint32_t sample_rate = 100;
+		//RollingFileLogAppender
+		size_t max_size = 64 * 1024 * 1024;
+		uint32_t roll_interval = 86400;
+		uint32_t max_files = 0;
 			
 		bool operator==(const LogAppenderDefine& oth) const {
 			return type == oth.type
 				&& level == oth.level
 				&& formatter == oth.formatter
-				&& file == oth.file;
+				&& file == oth.file
+				&& overflow == oth.overflow
+				&& buffer_size == oth.buffer_size
+				&& max_buffers == oth.max_buffers
+				&& flush_interval == oth.flush_interval
+				&& sample_rate == oth.sample_rate
+				&& max_size == oth.max_size
+				&& roll_interval == oth.roll_interval
+				&& max_files == oth.max_files;
 		}
 	};
 	
@@ -621,6 +1583,60 @@ const char* LogLevel::ToString(LogLevel::Level level) {
 						else if(type == "StdoutLogAppender") {
 							lad.type = 2;
 						}
+						else if(type == "AsyncLogAppender" || type == "BinaryLogAppender") {
+							//AsyncLogAppenderûfileʱ׼
+							lad.type = type == "AsyncLogAppender" ? 3 : 5;
+							if(lad.type == 5 && !a["file"].IsDefined()) {
+								std::cout << "log config errorbinaryappender file is null, " << a
+							<< std::endl;
+							continue;
+							}
+							if(a["file"].IsDefined()) {
+								lad.file = a["file"].as<std::string>();
+							}
+							if(a["formatter"].IsDefined()) {
+								lad.formatter = a["formatter"].as<std::string>();
+							}
+							if(a["overflow"].IsDefined()) {
+								lad.overflow = a["overflow"].as<std::string>();
+							}
+							if(a["buffer_size"].IsDefined()) {
+								lad.buffer_size = a["buffer_size"].as<size_t>();
+							}
+							if(a["max_buffers"].IsDefined()) {
+								lad.max_buffers = a["max_buffers"].as<size_t>();
+							}
+							if(a["flush_interval"].IsDefined()) {
+								lad.flush_interval = a["flush_interval"].as<uint32_t>();
+							}
+							if(a["sample_rate"].IsDefined()) {
+								lad.sample_rate = a["sample_rate"].as<uint32_t>();
+							}
+						}
+						else if(type == "RollingFileLogAppender") {
+							lad.type = 4;
+							if(!a["file"].IsDefined()) {
+								std::cout << "log config errorrollingfileappender file is null, " << a
+							<< std::endl;
+							continue;
+							}
+							lad.file = a["file"].as<std::string>();
+							if(a["formatter"].IsDefined()) {
+								lad.formatter = a["formatter"].as<std::string>();
+							}
+							if(a["max_size"].IsDefined()) {
+								lad.max_size = a["max_size"].as<size_t>();
+							}
+							if(a["roll_interval"].IsDefined()) {
+								lad.roll_interval = a["roll_interval"].as<uint32_t>();
+							}
+							if(a["max_files"].IsDefined()) {
+								lad.max_files = a["max_files"].as<uint32_t>();
+							}
+							if(a["flush_interval"].IsDefined()) {
+								lad.flush_interval = a["flush_interval"].as<uint32_t>();
+							}
+						}
 						else {
 							std::cout << "log config errorappender type is invalid, " << a
 							<< std::endl;
@@ -659,6 +1675,25 @@ const char* LogLevel::ToString(LogLevel::Level level) {
 						na["type"] = "StdoutLogAppender";
 						na["file"] = a.file;
 					}
+					else if(a.type == 3 || a.type == 5) {
+						na["type"] = a.type == 3 ? "AsyncLogAppender" : "BinaryLogAppender";
+						if(!a.file.empty()) {
+							na["file"] = a.file;
+						}
+						na["overflow"] = a.overflow;
+						na["buffer_size"] = a.buffer_size;
+						na["max_buffers"] = a.max_buffers;
+						na["flush_interval"] = a.flush_interval;
+						na["sample_rate"] = a.sample_rate;
+					}
+					else if(a.type == 4) {
+						na["type"] = "RollingFileLogAppender";
+						na["file"] = a.file;
+						na["max_size"] = a.max_size;
+						na["roll_interval"] = a.roll_interval;
+						na["max_files"] = a.max_files;
+						na["flush_interval"] = a.flush_interval;
+					}
 					if(a.level != LogLevel::UNKNOW)  {
 						na["level"] = LogLevel::ToString(a.level);
 					}	
@@ -710,6 +1745,18 @@ const char* LogLevel::ToString(LogLevel::Level level) {
 					else if(a.type == 2) {
 						ap.reset(new StdoutLogAppender);
 					}
+					else if(a.type == 3) {
+						ap.reset(new AsyncLogAppender(a.file, a.buffer_size, a.max_buffers
+							, AsyncLogAppender::OverflowFromString(a.overflow), a.flush_interval, a.sample_rate));
+					}
+					else if(a.type == 4) {
+						ap.reset(new RollingFileLogAppender(a.file, a.max_size, a.roll_interval
+							, a.max_files, a.flush_interval));
+					}
+					else if(a.type == 5) {
+						ap.reset(new BinaryLogAppender(a.file, a.buffer_size, a.max_buffers
+							, AsyncLogAppender::OverflowFromString(a.overflow), a.flush_interval, a.sample_rate));
+					}
 					ap->setLevel(a.level);
 					if(!a.formatter.empty()) {
 					  LogFormatter::ptr fmt(new LogFormatter(a.formatter));
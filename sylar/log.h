@@ -9,16 +9,19 @@
 #include<fstream>
 #include<vector>
 #include<stdarg.h>
+#include<string.h>
 #include<map>
+#include<atomic>
+#include<algorithm>
 #include "util.h"
 #include "singleton.h"
 #include "thread.h"
 
 #define SYLAR_LOG_LEVEL(logger, level) \
     if(logger->getLevel() <= level) \
-        sylar::LogEventWrap(sylar::LogEvent::ptr(new sylar::LogEvent(logger, level, \
+        sylar::LogEventWrap(logger, level, \
                         __FILE__, __LINE__, 0, sylar::GetThreadId(),\
-                sylar::GetFiberId(), time(0), sylar::Thread::GetName()))).getSS()
+                sylar::GetFiberId(), sylar::GetCoarseTime(), sylar::Thread::GetName()).getSS()
 				
 #define SYLAR_LOG_DEBUG(logger) SYLAR_LOG_LEVEL(logger, sylar::LogLevel::DEBUG)
 #define SYLAR_LOG_INFO(logger) SYLAR_LOG_LEVEL(logger, sylar::LogLevel::INFO)
@@ -28,9 +31,9 @@
 	
 #define SYLAR_LOG_FMT_LEVEL(logger, level, fmt, ...) \
 	if(logger->getLevel() <= level) \
-		sylar::LogEventWrap(sylar::LogEvent::ptr(new sylar::LogEvent(logger, level, \
+		sylar::LogEventWrap(logger, level, \
 												__FILE__, __LINE__, 0, sylar::GetThreadId(),\
-								sylar::GetFiberId(), time(0), sylar::Thread::GetName()))).getEvent()->format(fmt, __VA_ARGS__)
+								sylar::GetFiberId(), sylar::GetCoarseTime(), sylar::Thread::GetName()).getEvent()->format(fmt, __VA_ARGS__)
 									
 #define SYLAR_LOG_FMT_DEBUG(logger, fmt, ...) SYLAR_LOG_FMT_LEVEL(logger, sylar::LogLevel::DEBUG, fmt, __VA_ARGS__)
 #define SYLAR_LOG_FMT_INFO(logger, fmt, ...) SYLAR_LOG_FMT_LEVEL(logger, sylar::LogLevel::INFO, fmt, __VA_ARGS__)
@@ -38,6 +41,28 @@
 #define SYLAR_LOG_FMT_ERROR(logger, fmt, ...) SYLAR_LOG_FMT_LEVEL(logger, sylar::LogLevel::ERROR, fmt, __VA_ARGS__)
 #define SYLAR_LOG_FMT_FATAL(logger, fmt, ...) SYLAR_LOG_FMT_LEVEL(logger, sylar::LogLevel::FATAL, fmt, __VA_ARGS__)
 	
+//限流的日志，每个调用点一个静态的限流状态，判断过程不加锁
+//被抑制的条数在下一条输出的日志开头以[suppressed N]给出；抑制开始一秒后还没有输出过时，
+//由之后被抑制的一次调用单独输出一条汇总。FIRST_N在开始抑制时输出一条说明
+#define SYLAR_LOG_LIMITED(logger, level, limiter, ...) \
+	for(uint64_t sylar_log_suppressed = 0, sylar_log_once = 1; \
+			sylar_log_once && logger->getLevel() <= level \
+			&& ([]() -> limiter& { static limiter s_limiter; return s_limiter;}().allow(__VA_ARGS__, sylar_log_suppressed) \
+				|| (sylar_log_suppressed && sylar::LogSuppressedSummary<limiter>(logger, level \
+						, __FILE__, __LINE__, sylar_log_suppressed))); \
+			sylar_log_once = 0) \
+		sylar::LogEventWrap(logger, level, \
+						__FILE__, __LINE__, 0, sylar::GetThreadId(),\
+				sylar::GetFiberId(), sylar::GetCoarseTime(), sylar::Thread::GetName()).getSS() \
+				<< sylar::LogSuppressed(sylar_log_suppressed)
+
+//每n条输出一条（第1、n+1、2n+1...条）
+#define SYLAR_LOG_EVERY_N(logger, level, n) SYLAR_LOG_LIMITED(logger, level, sylar::LogEveryN, n)
+//只输出前n条
+#define SYLAR_LOG_FIRST_N(logger, level, n) SYLAR_LOG_LIMITED(logger, level, sylar::LogFirstN, n)
+//令牌桶限流，平均每秒最多per_sec条，允许一秒内的突发
+#define SYLAR_LOG_RATELIMITED(logger, level, per_sec) SYLAR_LOG_LIMITED(logger, level, sylar::LogRateLimiter, per_sec)
+
 #define SYLAR_LOG_ROOT() sylar::LoggerMgr::GetInstance()->getRoot()
 #define SYLAR_LOG_NAME(name) sylar::LoggerMgr::GetInstance()->getLogger(name)
 	
@@ -60,8 +85,110 @@ public:
 	static LogLevel::Level FromString(const std::string& str);
 };
 
+//日志内容的输出流，写入可以自动扩容的连续内存，reset()只清空内容不释放内存，复用时不需要再分配
+class LogStream : public std::ostream {
+public:
+	LogStream();
+	const char* data() const { return m_buf.data();}
+	size_t size() const { return m_buf.size();}
+	std::string str() const { return std::string(data(), size());}
+	void reset();
+	//追加printf格式的内容
+	void vformat(const char* fmt, va_list al);
+
+	//字符串和整数直接写入缓冲区，跳过std::ostream的sentry和locale，设置了进制、宽度等格式时仍由std::ostream处理
+	LogStream& operator<<(const char* v) {
+		if(v && width() == 0) {
+			append(v, strlen(v));
+		}
+		else {
+			static_cast<std::ostream&>(*this) << v;
+		}
+		return *this;
+	}
+	LogStream& operator<<(const std::string& v) {
+		if(width() == 0) {
+			append(v.c_str(), v.size());
+		}
+		else {
+			static_cast<std::ostream&>(*this) << v;
+		}
+		return *this;
+	}
+	LogStream& operator<<(char v) {
+		if(width() == 0) {
+			append(&v, 1);
+		}
+		else {
+			static_cast<std::ostream&>(*this) << v;
+		}
+		return *this;
+	}
+	LogStream& operator<<(short v) { return appendInteger(v);}
+	LogStream& operator<<(unsigned short v) { return appendInteger(v);}
+	LogStream& operator<<(int v) { return appendInteger(v);}
+	LogStream& operator<<(unsigned int v) { return appendInteger(v);}
+	LogStream& operator<<(long v) { return appendInteger(v);}
+	LogStream& operator<<(unsigned long v) { return appendInteger(v);}
+	LogStream& operator<<(long long v) { return appendInteger(v);}
+	LogStream& operator<<(unsigned long long v) { return appendInteger(v);}
+	//std::endl等操纵符
+	LogStream& operator<<(std::ostream& (*pf)(std::ostream&)) { pf(*this); return *this;}
+	LogStream& operator<<(std::ios_base& (*pf)(std::ios_base&)) { pf(*this); return *this;}
+	//其余类型使用std::ostream的输出
+	template<class T>
+	LogStream& operator<<(const T& v) {
+		static_cast<std::ostream&>(*this) << v;
+		return *this;
+	}
+	void append(const char* v, size_t len) {
+		memcpy(m_buf.reserve(len), v, len);
+		m_buf.commit(len);
+	}
+private:
+	template<class T>
+	LogStream& appendInteger(T v) {
+		if(width() != 0 || (flags() & (std::ios::basefield | std::ios::showpos)) != std::ios::dec) {
+			static_cast<std::ostream&>(*this) << v;
+		}
+		else if(v < 0) {
+			appendDecimal(0 - (uint64_t)v, true);
+		}
+		else {
+			appendDecimal((uint64_t)v, false);
+		}
+		return *this;
+	}
+	void appendDecimal(uint64_t v, bool neg);
+private:
+	class Buffer : public std::streambuf {
+	public:
+		const char* data() const { return pbase();}
+		size_t size() const { return pptr() - pbase();}
+		size_t available() const { return epptr() - pptr();}
+		//保证至少还有n字节可写，返回写入位置
+		char* reserve(size_t n) {
+			if(available() < n) {
+				grow(n);
+			}
+			return pptr();
+		}
+		void commit(size_t n) { pbump(n);}
+		void reset();
+	protected:
+		int_type overflow(int_type c) override;
+		std::streamsize xsputn(const char* s, std::streamsize n) override;
+	private:
+		void grow(size_t n);
+	private:
+		std::vector<char> m_data;
+	};
+	Buffer m_buf;
+};
+
 //日志事件
 class LogEvent{
+friend class LogEventWrap;
 public:
 	typedef std::shared_ptr<LogEvent> ptr;
 	LogEvent(std::shared_ptr<Logger> logger, LogLevel::Level level, const char* file, int32_t m_line, uint32_t elapse, uint32_t thread_id
@@ -73,11 +200,12 @@ public:
 	uint32_t getFiberId()const {return m_fiberId;}
 	uint64_t getTime()const { return m_time;}
 	const std::string getContent()const {return m_ss.str();}
-  std::shared_ptr<Logger> getLogger() const {return m_logger; }
+	const LogStream& getStream() const { return m_ss;}
+  const std::shared_ptr<Logger>& getLogger() const {return m_logger; }
   LogLevel::Level getLevel() const {return m_level;} 
   const std::string& getThreadName() const { return m_threadName;}
 		
-	std::stringstream& getSS() {return m_ss;}
+	LogStream& getSS() {return m_ss;}
 	void format(const char* fmt, ...);
 	void format(const char* fmt, va_list al);
 private:
@@ -87,46 +215,199 @@ private:
 	uint32_t m_threadId = 0;			//线程id
 	uint32_t m_fiberId = 0;				//协程id
 	uint64_t m_time = 0;					//时间戳
-	std::stringstream m_ss;				//
+	LogStream m_ss;								//日志内容
 	std::string m_threadName;
 	
 	std::shared_ptr<Logger> m_logger;
 	LogLevel::Level m_level;
 };
 
-class LogEventWrap{
+class LogEventWrap : Noncopyable {
 public:
 	LogEventWrap(LogEvent::ptr e);
+	//从线程私有的事件池中取出一个空闲事件并初始化，日志宏使用，事件对象和内容缓冲区都会被复用
+	//事件被外部继续持有时不会被复用，池中没有空闲事件时新建
+	LogEventWrap(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const char* file, int32_t line
+	, uint32_t elapse, uint32_t thread_id, uint32_t fiber_id, uint64_t time, const std::string& thread_name);
 	~LogEventWrap();
-	std::stringstream& getSS();
-	sylar::LogEvent::ptr getEvent() { return m_event;}
+	LogStream& getSS();
+	const sylar::LogEvent::ptr& getEvent() { return *m_event;}
+private:
+	LogEvent::ptr* m_event;				//指向m_owned或者事件池中的事件
+	LogEvent::ptr m_owned;
+	bool* m_busy = nullptr;				//事件池中对应位置的占用标记
+};
+
+//限流日志开头的被抑制条数，为0时不输出
+struct LogSuppressed {
+	LogSuppressed(uint64_t v) : count(v) {}
+	uint64_t count;
+};
+
+inline std::ostream& operator<<(std::ostream& os, const LogSuppressed& v) {
+	if(v.count) {
+		os << "[suppressed " << v.count << "] ";
+	}
+	return os;
+}
+
+//被抑制的条数和汇总窗口，窗口从上一次取出条数之后的第一次抑制开始，长一秒
+class LogSuppressedCount {
+public:
+	//记录一条被抑制的日志，窗口已经结束时返回true，count为需要单独汇总的条数
+	bool add(uint64_t now_ms, uint64_t& count) {
+		m_count.fetch_add(1, std::memory_order_relaxed);
+		uint64_t end = m_windowEnd.load(std::memory_order_relaxed);
+		if(end == 0) {
+			m_windowEnd.compare_exchange_strong(end, now_ms + 1000, std::memory_order_relaxed);
+			return false;
+		}
+		if(now_ms < end || !m_windowEnd.compare_exchange_strong(end, 0, std::memory_order_relaxed)) {
+			return false;
+		}
+		count = m_count.exchange(0, std::memory_order_relaxed);
+		return count != 0;
+	}
+	//输出一条日志时取出之前被抑制的条数，关闭窗口
+	uint64_t take() {
+		m_windowEnd.store(0, std::memory_order_relaxed);
+		return m_count.exchange(0, std::memory_order_relaxed);
+	}
 private:
-	LogEvent::ptr m_event;
+	std::atomic<uint64_t> m_count = {0};
+	std::atomic<uint64_t> m_windowEnd = {0};		//窗口结束的粗粒度单调时间（毫秒），0表示没有打开
 };
 
+//限流日志宏的调用点状态，只有原子变量，静态对象不需要运行时初始化
+//allow()返回是否输出这一条，输出时suppressed为上一次输出之后被抑制的条数；
+//返回false并且suppressed不为0时由Summary()单独输出一条汇总
+class LogEveryN {
+public:
+	bool allow(uint64_t n, uint64_t& suppressed) {
+		uint64_t count = m_count.fetch_add(1, std::memory_order_relaxed);
+		if(n <= 1) {
+			return true;
+		}
+		if(count % n) {
+			m_suppressed.add(GetCoarseMonotonicMS(), suppressed);
+			return false;
+		}
+		suppressed = m_suppressed.take();
+		return true;
+	}
+	static void Summary(std::ostream& os, uint64_t count) {
+		os << LogSuppressed(count) << "sampled out";
+	}
+private:
+	std::atomic<uint64_t> m_count = {0};
+	LogSuppressedCount m_suppressed;
+};
+
+class LogFirstN {
+public:
+	bool allow(uint64_t n, uint64_t& suppressed) {
+		//超过之后只读不写，不再争用缓存行；第n+1条仍然计数，用来报告一次
+		if(m_count.load(std::memory_order_relaxed) > n) {
+			return false;
+		}
+		uint64_t count = m_count.fetch_add(1, std::memory_order_relaxed);
+		if(count == n) {
+			suppressed = n;
+		}
+		return count < n;
+	}
+	static void Summary(std::ostream& os, uint64_t n) {
+		os << "[suppressed] logged the first " << n << ", further messages suppressed";
+	}
+private:
+	std::atomic<uint64_t> m_count = {0};
+};
+
+//GCRA形式的令牌桶，只保存下一个令牌的理论到达时间（微秒），使用粗粒度单调时钟
+class LogRateLimiter {
+public:
+	bool allow(uint64_t per_sec, uint64_t& suppressed) {
+		uint64_t now_ms = GetCoarseMonotonicMS();
+		if(per_sec == 0) {
+			m_suppressed.add(now_ms, suppressed);
+			return false;
+		}
+		uint64_t now = now_ms * 1000;
+		uint64_t interval = std::max(1000000 / per_sec, (uint64_t)1);
+		uint64_t tolerance = interval * (per_sec - 1);
+		uint64_t tat = m_tat.load(std::memory_order_relaxed);
+		do {
+			if(tat > now + tolerance) {
+				m_suppressed.add(now_ms, suppressed);
+				return false;
+			}
+		} while(!m_tat.compare_exchange_weak(tat, std::max(tat, now) + interval, std::memory_order_relaxed));
+		suppressed = m_suppressed.take();
+		return true;
+	}
+	static void Summary(std::ostream& os, uint64_t count) {
+		os << LogSuppressed(count) << "rate limited";
+	}
+private:
+	std::atomic<uint64_t> m_tat = {0};
+	LogSuppressedCount m_suppressed;
+};
+
+//单独输出限流的汇总，返回false让宏跳过被抑制的这一条
+template<class Limiter>
+bool LogSuppressedSummary(const std::shared_ptr<Logger>& logger, LogLevel::Level level
+		, const char* file, int32_t line, uint64_t count) {
+	Limiter::Summary(LogEventWrap(logger, level, file, line, 0, GetThreadId()
+			, GetFiberId(), GetCoarseTime(), Thread::GetName()).getSS(), count);
+	return false;
+}
+
 //日志格式器
+//模式串在init()中编译成一组操作码，输出时顺序执行，不需要虚函数调用，相邻的字面字符串合并成一条
 class LogFormatter {
 public:
 	typedef std::shared_ptr<LogFormatter> ptr;
 	LogFormatter (const std::string& pattern);
 		
 	//%t	%thread_id%m%n
-	std::string format(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event);
-public:
-	class FormatItem {
-		public:
-			typedef std::shared_ptr<FormatItem> ptr;
-			virtual ~FormatItem() {}
-			virtual void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) = 0;
-	};
+	std::string format(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event);
+	//直接输出到os，不产生中间字符串
+	std::ostream& format(std::ostream& os, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event);
+	//输出到LogStream时不经过std::ostream的格式化，%n只追加换行不刷新
+	LogStream& format(LogStream& os, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event);
 	
 	void init();
 	
 	bool isError() const { return m_error;}
 	const std::string getPattern() const { return m_pattern;}
+private:
+	enum OpCode {
+		OP_STRING,				//字面字符串，%T也编译成字面的\t
+		OP_MESSAGE,				//%m
+		OP_LEVEL,					//%p
+		OP_ELAPSE,				//%r
+		OP_NAME,					//%c
+		OP_THREAD_ID,			//%t
+		OP_NEWLINE,				//%n
+		OP_DATETIME,			//%d，str为strftime格式
+		OP_FILENAME,			//%f
+		OP_LINE,					//%l
+		OP_FIBER_ID,			//%F
+		OP_THREAD_NAME		//%N
+	};
+	struct Op {
+		OpCode code;
+		std::string str;
+	};
+	void addOp(OpCode code, const std::string& str = "");
+	template<class Stream>
+	void run(Stream& os, LogLevel::Level level, const LogEvent::ptr& event);
+	//格式化时间，同一秒内直接使用线程私有的缓存结果
+	void formatTime(const Op& op, uint64_t time, const char*& str, size_t& len);
 private:
 	std::string m_pattern;
-	std::vector<FormatItem::ptr> m_items;
+	std::vector<Op> m_ops;
+	uint64_t m_id;				//进程内唯一编号，区分时间缓存
 	bool m_error = false;
 };
 
@@ -137,7 +418,9 @@ public:
 	typedef Spinlock MutexType;
 	typedef std::shared_ptr<LogAppender> ptr;
 	virtual ~LogAppender(){}
-	virtual void log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) = 0;
+	virtual void log(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) = 0;
+	//输出一条二进制日志记录（见binlog.h），默认还原成文本后调用log()
+	virtual void logBinary(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const char* data, size_t len);
 	virtual std::string toYamlString() = 0;
 	void setFormatter(LogFormatter::ptr val);
 	LogFormatter::ptr getFormatter();
@@ -151,13 +434,19 @@ protected:
 };
 
 //日志输出器
+//appender列表以不可修改的快照发布，修改时复制一份再原子替换，写日志时不加锁也不修改引用计数，
+//旧列表等所有正在遍历它的线程结束之后才释放
 class Logger : public std::enable_shared_from_this<Logger> {
 friend class LoggerManager;
 public:
 	typedef Spinlock MutexType;
 	typedef std::shared_ptr<Logger> ptr;
+	typedef std::vector<LogAppender::ptr> AppenderList;
 	Logger(const std::string& name = "root");
-	void log(LogLevel::Level level, LogEvent::ptr event);
+	~Logger();
+	void log(LogLevel::Level level, const LogEvent::ptr& event);
+	//输出一条二进制日志记录，source为产生日志的logger，交给root输出时保持不变
+	void logBinary(const Logger::ptr& source, LogLevel::Level level, const char* data, size_t len);
 	void debug(LogEvent::ptr event);
 	void info(LogEvent::ptr event);
 	void warn(LogEvent::ptr event);
@@ -175,11 +464,15 @@ public:
 		
 	LogFormatter::ptr getFormatter();
 	std::string toYamlString();
+private:
+	class AppenderSnapshot;
+	//发布新的appender列表，返回旧列表，需要持有m_mutex，解锁后交给RetireAppenders释放
+	const AppenderList* setAppenders(AppenderList* appenders);
 private:
 	std::string m_name;															//日志名称
 	LogLevel::Level m_level;												//日志级别
-	MutexType m_mutex;
-	std::list<LogAppender::ptr> m_appenders;				//Appender集合
+	MutexType m_mutex;															//保护修改，写日志时不加锁
+	std::atomic<const AppenderList*> m_appenders;		//Appender集合的当前快照
 	LogFormatter::ptr m_formatter;
 	Logger::ptr m_root;
 
@@ -189,7 +482,7 @@ private:
 class StdoutLogAppender : public LogAppender{
 public:
 	typedef std::shared_ptr<StdoutLogAppender> ptr;
-	virtual void log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override;
+	virtual void log(const Logger::ptr& logger, LogLevel::Level level, const LogEvent::ptr& event) override;
 	std::string toYamlString() override;
 private:
 };
@@ -199,7 +492,7 @@ class FileLogAppender : public LogAppender{
 public:
 	typedef std::shared_ptr<FileLogAppender> ptr;
 	FileLogAppender(const std::string& filename);
-	virtual void log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override;
+	virtual void log(const Logger::ptr& logger, LogLevel::Level level, const LogEvent::ptr& event) override;
 	std::string toYamlString() override;
 	//重新打开文件，文件打开成功，返回ture	
 	bool reopen();
@@ -209,11 +502,144 @@ private:
 	uint64_t m_lastTime = 0;
 };
 
+//异步输出的Appender，写日志的线程只负责格式化并拷贝到内存缓冲区，由后台线程批量写入文件
+//缓冲区写满后交给后台线程，最多积压max_buffers个缓冲区，超出后按溢出策略处理
+class AsyncLogAppender : public LogAppender {
+public:
+	typedef std::shared_ptr<AsyncLogAppender> ptr;
+	//溢出策略
+	enum Overflow {
+		BLOCK = 0,		//阻塞写日志的线程，直到后台线程腾出缓冲区
+		DROP = 1,			//丢弃
+		SAMPLE = 2		//每sample_rate条阻塞写入一条，其余丢弃
+	};
+	static const char* OverflowToString(Overflow v);
+	static Overflow OverflowFromString(const std::string& str);
+
+	//filename为空时输出到标准输出，flush_interval为后台线程最长多久写出一次未满的缓冲区
+	AsyncLogAppender(const std::string& filename, size_t buffer_size = 4 * 1024 * 1024
+			, size_t max_buffers = 16, Overflow overflow = DROP, uint32_t flush_interval = 1000
+			, uint32_t sample_rate = 100);
+	~AsyncLogAppender();
+	virtual void log(const Logger::ptr& logger, LogLevel::Level level, const LogEvent::ptr& event) override;
+	std::string toYamlString() override;
+	//重新打开文件，用于日志文件被外部移走之后
+	bool reopen();
+	//写出剩余的日志并停止后台线程，之后的日志直接丢弃
+	void stop();
+
+	uint64_t getDroppedCount() const { return m_dropped;}
+	uint64_t getBlockedCount() const { return m_blocked;}
+protected:
+	//拷贝一条日志到当前缓冲区，返回false表示被丢弃，超过缓冲区大小的日志被截断
+	bool append(LogLevel::Level level, const char* msg, size_t len);
+	//后台线程写出一批缓冲区之前调用，可以用writeData()在前面写入额外的数据
+	virtual void beforeWrite() {}
+	void writeData(const char* data, size_t len);
+	size_t getBufferSize() const { return m_bufferSize;}
+	//每次打开文件加一，用于判断是否写入了新文件
+	uint64_t getGeneration() const { return m_generation;}
+protected:
+	std::atomic<uint64_t> m_dropped = {0};
+private:
+	struct Buffer {
+		Buffer(size_t cap) : data(new char[cap]), size(0) {}
+		~Buffer() { delete[] data;}
+		char* data;
+		size_t size;
+	};
+	//后台线程
+	void run();
+	void writeAll(const std::vector<Buffer*>& buffers);
+private:
+	std::string m_filename;
+	int m_fd = -1;
+	size_t m_bufferSize;
+	size_t m_maxBuffers;
+	Overflow m_overflow;
+	uint32_t m_flushInterval;
+	uint32_t m_sampleRate;
+
+	Spinlock m_bufMutex;
+	Buffer* m_current = nullptr;				//正在写入的缓冲区
+	std::vector<Buffer*> m_full;				//写满等待后台线程写出的缓冲区
+	std::vector<Buffer*> m_spare;				//后台线程写完归还的空缓冲区
+	size_t m_waiters = 0;								//因为溢出阻塞等待的线程数
+	bool m_stopping = false;
+	Semaphore m_notify;									//唤醒后台线程
+	Semaphore m_space;									//唤醒阻塞等待的线程
+	Thread::ptr m_thread;
+
+	std::atomic<uint64_t> m_blocked = {0};
+	std::atomic<uint64_t> m_overflowCount = {0};
+	std::atomic<uint64_t> m_generation = {0};
+};
+
+//按大小和时间滚动的文件Appender，日志拷贝到预先分配并映射好的文件区域，不经过write系统调用
+//当前文件写满max_size或者到达roll_interval秒的整点边界时切换到后台线程预先准备好的下一个文件，
+//写日志的线程只交换指针，旧文件的msync、截断、改名和过期文件的删除都在后台线程完成
+//归档文件名为 文件名.年月日-时分秒，max_files为保留的归档文件数，0表示不删除
+class RollingFileLogAppender : public LogAppender {
+public:
+	typedef std::shared_ptr<RollingFileLogAppender> ptr;
+	RollingFileLogAppender(const std::string& filename, size_t max_size = 64 * 1024 * 1024
+			, uint32_t roll_interval = 86400, uint32_t max_files = 0, uint32_t flush_interval = 1000);
+	~RollingFileLogAppender();
+	virtual void log(const Logger::ptr& logger, LogLevel::Level level, const LogEvent::ptr& event) override;
+	std::string toYamlString() override;
+	//写出剩余的日志并停止后台线程，之后的日志直接丢弃
+	void stop();
+
+	uint64_t getDroppedCount() const { return m_dropped;}
+	uint64_t getRollCount() const { return m_rolls;}
+private:
+	//映射到内存的日志文件
+	struct MappedFile {
+		std::string path;
+		int fd = -1;
+		char* base = nullptr;
+		size_t size = 0;				//已写入的字节数
+		size_t cap = 0;					//映射的大小
+		size_t synced = 0;			//已经msync的位置，只由后台线程访问
+	};
+	bool append(const char* msg, size_t len, uint64_t time);
+	//创建、预分配并映射文件
+	MappedFile* openFile(const std::string& path);
+	//同步并解除映射，文件截断到实际写入的大小
+	void closeFile(MappedFile* file);
+	void archive(MappedFile* file);
+	//列出目录下的归档文件或者预先创建的.next文件，按文件名排序
+	void listFiles(std::vector<std::string>& files, bool next);
+	void removeExpired();
+	uint64_t nextRollTime(uint64_t now) const;
+	void run();
+private:
+	std::string m_filename;
+	size_t m_maxSize;
+	uint32_t m_rollInterval;
+	uint32_t m_maxFiles;
+	uint32_t m_flushInterval;
+
+	Spinlock m_fileMutex;
+	MappedFile* m_current = nullptr;				//正在写入的文件
+	MappedFile* m_next = nullptr;						//后台线程准备好的下一个文件
+	std::vector<MappedFile*> m_retired;			//已经切换掉，等待后台线程归档的文件
+	uint64_t m_rollTime = 0;								//下一次按时间滚动的时间点
+	uint64_t m_nextSeq = 0;
+	bool m_stopping = false;
+	Semaphore m_notify;
+	Thread::ptr m_thread;
+
+	std::atomic<uint64_t> m_dropped = {0};
+	std::atomic<uint64_t> m_rolls = {0};
+};
+
 //日志管理器
 class LoggerManager {
 public:
 	typedef Spinlock MutexType;
 	LoggerManager();
+	//logger创建后不会删除，查找结果缓存在线程私有的表中，已经查找过的名称不加锁
 	Logger::ptr getLogger(const std::string& name);
 	void init();
 	Logger::ptr getRoot() const { return m_root;}
@@ -2,6 +2,7 @@
 #include "log.h"
 #include "macro.h"
 #include "hook.h"
+#include "config.h"
 
 namespace sylar {
 	
@@ -11,6 +12,26 @@ namespace sylar {
 	static thread_local Scheduler* t_scheduler = nullptr;
 	//Э̺
 	static thread_local Fiber* t_fiber = nullptr;
+	//ǰ̵߳ı
+	static thread_local void* t_queue = nullptr;
+	//ǰ̵߳±
+	static thread_local int t_worker_index = -1;
+	
+	static ConfigVar<uint32_t>::ptr g_scheduler_fiber_pool_size =
+		Config::Lookup<uint32_t>("scheduler.fiber_pool_size", 64, "max idle callback fibers cached per worker");
+	
+	static uint32_t s_fiber_pool_size = 64;
+	
+	struct _SchedulerIniter {
+		_SchedulerIniter() {
+			s_fiber_pool_size = g_scheduler_fiber_pool_size->getValue();
+			g_scheduler_fiber_pool_size->addListener([](const uint32_t& old_value, const uint32_t& new_value){
+				s_fiber_pool_size = new_value;
+			});
+		}
+	};
+	
+	static _SchedulerIniter s_scheduler_initer;
 	
 	Scheduler::Scheduler(size_t threads, bool use_caller, const std::string& name) 
 		:m_name(name) {
@@ -32,6 +53,13 @@ namespace sylar {
 			m_rootThread = -1;
 		}
 		m_threadCount = threads;
+		
+		m_queues.resize(m_threadCount + (use_caller ? 1 : 0));
+		for(size_t i = 0; i < m_queues.size(); ++i) {
+			m_queues[i] = new WorkQueue;
+		}
+		//ջڵһʹʱŷ
+		m_sharedStacks = new SharedStackSet;
 	}
 	
 	Scheduler::~Scheduler() {
@@ -39,6 +67,11 @@ namespace sylar {
 		if(GetThis() == this) { 
 			t_scheduler = nullptr;
 		}
+		for(size_t i = 0; i < m_queues.size(); ++i) {
+			delete m_queues[i];
+		}
+		m_fibers.clear();
+		delete m_sharedStacks;
 	}
 		
 	Scheduler* Scheduler::GetThis() {
@@ -48,6 +81,10 @@ namespace sylar {
 	Fiber* Scheduler::GetMainFiber() {
 		return t_fiber;
 	}
+	
+	int Scheduler::GetWorkerIndex() {
+		return t_worker_index;
+	}
 	//ʼ̳߳	
 	void Scheduler::start() {
 		MutexType::Lock lock(m_mutex);
@@ -56,6 +93,8 @@ namespace sylar {
 		}
 		m_stopping = false;
 		SYLAR_ASSERT(m_threads.empty());
+		//stop()֮start()һ̶ֵ߳˳ضдͷȡ
+		m_queueIndex = 0;
 		
 		m_threads.resize(m_threadCount);
 		//Ϊ̳߳Ӷ
@@ -127,6 +166,15 @@ namespace sylar {
 	void Scheduler::setThis() {
 		t_scheduler = this;
 	}
+	//ڻصЭִ񣬽׳쳣黹
+	static void RunTask(Task* task) {
+		struct TaskGuard {
+			Task* task;
+			~TaskGuard() { Task::Destroy(task);}
+		} guard = {task};
+		task->invoke();
+	}
+	
 	//Ĵ룬же
 	void Scheduler::run() {
 		SYLAR_LOG_INFO(g_logger) << "run";
@@ -137,65 +185,109 @@ namespace sylar {
 			t_fiber = Fiber::GetThis().get();
 		}
 		
+		//ȡ̵߳ıضУ߳stop()ʱŽrun()̶ʹһ
+		size_t index = sylar::GetThreadId() == m_rootThread ? m_queues.size() - 1 : m_queueIndex++;
+		SYLAR_ASSERT(index < m_queues.size());
+		WorkQueue* queue = m_queues[index];
+		queue->threadId = sylar::GetThreadId();
+		t_queue = queue;
+		t_worker_index = index;
+		
 		Fiber::ptr idle_fiber(new Fiber(std::bind(&Scheduler::idle, this)));
 		Fiber::ptr cb_fiber;
+		//̵߳ĻصЭ̳أִнĻصЭúŻأһصֱӸ
+		std::vector<Fiber::ptr> fiber_pool;
 			
-		FiberAndThread ft;
+		uint64_t tick = 0;
 		while(true) {
-			ft.reset();
-			bool tickle_me = false;
+			Task* task = nullptr;
+			int tickle_thread = -1;
 			bool is_active = false;
-			{
-				MutexType::Lock lock(m_mutex);
-				auto it = m_fibers.begin();
-				while(it != m_fibers.end()) {
-					if(it->thread != -1 && it->thread != sylar::GetThreadId()) { //ǰ̲߳ΪЭָ߳
-						++it;
-						tickle_me = true;
-						continue;
-					}
-					SYLAR_ASSERT(it->fiber || it->cb);
-					if(it->fiber && it->fiber->getState() == Fiber::EXEC) {
-						++it;
-						continue;
-					}
-					
-					ft = *it; //õһ
-					m_fibers.erase(it);
-				  ++m_activeThreadCount;
-				  is_active = true;
-					break;
+			//ضȣÿ61ȼһעУⱾضһֱǿʱע񼢶
+			if(m_taskCount > 0) {
+				if(++tick % 61 == 0) {
+					is_active = popInjected(task, tickle_thread);
+				}
+				if(!is_active) {
+					is_active = popLocal(queue, task);
+				}
+				if(!is_active) {
+					is_active = popInjected(task, tickle_thread);
+				}
+				if(!is_active) {
+					is_active = steal(index, task, tickle_thread);
 				}
 			}
-			if(tickle_me) {
-				tickle();
+			if(tickle_thread != -1) {
+				tickleThread(tickle_thread);
 			}
 			
 			//ִõ
 			//1fiberΪִЭ
-			if(ft.fiber && (ft.fiber->getState() != Fiber::TERM
-				|| ft.fiber->getState() != Fiber::EXCEPT)) {
-				ft.fiber->swapIn();
-				--m_activeThreadCount;
-				if(ft.fiber->getState() == Fiber::READY) {
-					schedule(ft.fiber);
+			if(task && task->fiber && (task->fiber->getState() != Fiber::TERM
+				|| task->fiber->getState() != Fiber::EXCEPT)) {
+				Fiber::ptr& fiber = task->fiber;
+				if(fiber->m_shared && !fiber->m_sharedStacks && fiber->getState() == Fiber::INIT) {
+					//ֱӵȵĹջЭ̵һִʱҲʹñĹջ
+					fiber->m_sharedStacks = m_sharedStacks;
 				}
-				else if(ft.fiber->getState() != Fiber::TERM
-					&& ft.fiber->getState() != Fiber::EXCEPT) {
-					ft.fiber->m_state = Fiber::HOLD;	
+				if(!fiber->trySwapIn()) {
+					//󶨵Ĺջ߳ϵЭʹãŻضβԺִУ߳
+					if(enqueue(task)) {
+						tickleThread(task->thread);
+					}
+					--m_activeThreadCount;
+					continue;
+				}
+				//ټٻԾstopping()֮Ϊ
+				if(fiber->getState() == Fiber::READY) {
+					//ֱӸ
+					task->thread = -1;
+					if(enqueue(task)) {
+						tickle();
+					}
+					task = nullptr;
+				}
+				else if(fiber->getState() != Fiber::TERM
+					&& fiber->getState() != Fiber::EXCEPT) {
+					fiber->m_state = Fiber::HOLD;	
+				}
+				//֮ǰгĻصЭִнûʱյЭ̳
+				else if(fiber->m_pooled && fiber.use_count() == 1
+						&& fiber_pool.size() < s_fiber_pool_size) {
+					fiber->reset(nullptr);
+					fiber_pool.push_back(fiber);
+				}
+				--m_activeThreadCount;
+				if(task) {
+					Task::Destroy(task);
 				}
-				ft.reset();
 			}
-			else if(ft.cb) { //2Ϊִлص
+			else if(task && task->hasCallback()) { //2Ϊִлص
+				if(!cb_fiber && !fiber_pool.empty()) {
+					cb_fiber.swap(fiber_pool.back());
+					fiber_pool.pop_back();
+				}
+				//ָֻ룬std::functionڲֱӱ棬Ҫѷ
+				//ɻصЭִϺͷ
+				std::function<void()> cb = [task](){ RunTask(task);};
 				if(cb_fiber) {
-					cb_fiber->reset(ft.cb);
+					cb_fiber->reset(cb);
 				}
 				else {
-					cb_fiber.reset(new Fiber(ft.cb));
+					cb_fiber.reset(new Fiber(cb, 0, false, m_sharedStack));
+					cb_fiber->m_pooled = true;
+					cb_fiber->m_sharedStacks = m_sharedStacks;
+				}
+				if(!cb_fiber->trySwapIn()) {
+					//Ĺջ߳ʹãŻضβ
+					cb_fiber->reset(nullptr);
+					if(enqueue(task)) {
+						tickleThread(task->thread);
+					}
+					--m_activeThreadCount;
+					continue;
 				}
-				ft.reset();
-				cb_fiber->swapIn();
-				--m_activeThreadCount;
 				if(cb_fiber->getState() == Fiber::READY) {
 					schedule(cb_fiber);
 					cb_fiber.reset();
@@ -208,6 +300,7 @@ namespace sylar {
 					cb_fiber->m_state = Fiber::HOLD;
 					cb_fiber.reset();
 				}
+				--m_activeThreadCount;
 			}
 			else { //3߽ûУִidle_iber
 				if(is_active) {
@@ -228,16 +321,213 @@ namespace sylar {
 				}
 			}
 		}
+		t_queue = nullptr;
+		t_worker_index = -1;
+	}
+	
+	Scheduler::WorkQueue* Scheduler::getQueue(int thread) {
+		for(auto& i : m_queues) {
+			if(i->threadId == thread) {
+				return i;
+			}
+		}
+		return nullptr;
+	}
+	
+	bool Scheduler::enqueue(Task* task) {
+		WorkQueue* queue = nullptr;
+		bool other_thread = false;
+		if(task->thread != -1) {
+			queue = getQueue(task->thread);
+			other_thread = task->thread != sylar::GetThreadId();
+		}
+		else if(GetThis() == this) {
+			queue = (WorkQueue*)t_queue;
+		}
+		
+		bool need_tickle = false;
+		//̵ָ߳hasWork()ȡʱֻ౨©
+		++m_taskCount;
+		if(task->thread != -1) {
+			++m_pinnedCount;
+		}
+		if(queue) {
+			WorkQueue::MutexType::Lock lock(queue->mutex);
+			need_tickle = queue->tasks.empty() || other_thread;
+			queue->tasks.push_back(task);
+		}
+		else {
+			MutexType::Lock lock(m_mutex);
+			need_tickle = m_fibers.empty();
+			m_fibers.push_back(task);
+			++m_injectedCount;
+		}
+		return need_tickle;
+	}
+	
+	void Scheduler::schedule(Batch& batch) {
+		if(batch.empty()) {
+			return;
+		}
+		//̵ָ߳Ӧ̵߳ĶУһԷ뱾̱߳ضлע
+		size_t wake = 0;
+		TaskList tasks;
+		while(!batch.m_tasks.empty()) {
+			Task* task = batch.m_tasks.front();
+			batch.m_tasks.erase(task);
+			if(task->thread != -1) {
+				int thread = task->thread;
+				if(enqueue(task)) {
+					tickleThread(thread);
+				}
+			}
+			else {
+				tasks.push_back(task);
+			}
+		}
+		
+		size_t count = tasks.size();
+		if(count) {
+			m_taskCount += count;
+			WorkQueue* queue = GetThis() == this ? (WorkQueue*)t_queue : nullptr;
+			if(queue) {
+				WorkQueue::MutexType::Lock lock(queue->mutex);
+				queue->tasks.splice(tasks);
+			}
+			else {
+				MutexType::Lock lock(m_mutex);
+				m_fibers.splice(tasks);
+				m_injectedCount += count;
+			}
+			wake += count;
+		}
+		if(wake) {
+			tickleIdle(wake);
+		}
+	}
+	
+	bool Scheduler::popLocal(WorkQueue* queue, Task*& task) {
+		WorkQueue::MutexType::Lock lock(queue->mutex);
+		for(Task* it = queue->tasks.front(); it; it = it->next) {
+			SYLAR_ASSERT(!it->empty());
+			//Эִ߳Уձȵûгݲȡ
+			if(it->fiber && it->fiber->getState() == Fiber::EXEC) {
+				continue;
+			}
+			queue->tasks.erase(it);
+			task = it;
+			++m_activeThreadCount;
+			if(it->thread != -1) {
+				--m_pinnedCount;
+			}
+			--m_taskCount;
+			return true;
+		}
+		return false;
+	}
+	
+	bool Scheduler::popInjected(Task*& task, int& tickle_thread) {
+		if(m_injectedCount == 0) {
+			return false;
+		}
+		MutexType::Lock lock(m_mutex);
+		for(Task* it = m_fibers.front(); it; it = it->next) {
+			if(it->thread != -1 && it->thread != sylar::GetThreadId()) { //ǰ̲߳ΪЭָ߳
+				tickle_thread = it->thread;
+				continue;
+			}
+			SYLAR_ASSERT(!it->empty());
+			if(it->fiber && it->fiber->getState() == Fiber::EXEC) {
+				continue;
+			}
+			
+			m_fibers.erase(it); //õһ
+			task = it;
+			--m_injectedCount;
+			++m_activeThreadCount;
+			if(it->thread != -1) {
+				--m_pinnedCount;
+			}
+			--m_taskCount;
+			return true;
+		}
+		return false;
+	}
+	
+	bool Scheduler::steal(size_t index, Task*& task, int& tickle_thread) {
+		TaskList stolen;
+		for(size_t i = 1; i < m_queues.size() && stolen.empty(); ++i) {
+			WorkQueue* victim = m_queues[(index + i) % m_queues.size()];
+			WorkQueue::MutexType::Lock lock(victim->mutex);
+			size_t want = (victim->tasks.size() + 1) / 2;
+			//Ӷβȡ̵ִָ߳еЭ̲ܱȡ
+			Task* it = victim->tasks.back();
+			while(it && stolen.size() < want) {
+				Task* prev = it->prev;
+				if(it->thread != -1) {
+					tickle_thread = it->thread;
+				}
+				else if(!it->fiber || it->fiber->getState() != Fiber::EXEC) {
+					victim->tasks.erase(it);
+					stolen.push_back(it);
+				}
+				it = prev;
+			}
+		}
+		if(stolen.empty()) {
+			return false;
+		}
+		task = stolen.front();
+		stolen.erase(task);
+		if(!stolen.empty()) {
+			WorkQueue* queue = m_queues[index];
+			WorkQueue::MutexType::Lock lock(queue->mutex);
+			while(!stolen.empty()) {
+				Task* t = stolen.front();
+				stolen.erase(t);
+				queue->tasks.push_back(t);
+			}
+		}
+		++m_activeThreadCount;
+		--m_taskCount;
+		return true;
+	}
+	
+	void Scheduler::tickleIdle(size_t count) {
+		size_t idle = m_idleThreadCount;
+		if(count > idle) {
+			count = idle;
+		}
+		if(count == 0) {
+			count = 1;
+		}
+		for(size_t i = 0; i < count; ++i) {
+			tickle();
+		}
 	}
 	
 	void Scheduler::tickle() {
 		SYLAR_LOG_INFO(g_logger) << "tickle";
   }
+  
+	void Scheduler::tickleThread(int thread) {
+		tickle();
+	}
+	
+	bool Scheduler::hasWork() {
+		WorkQueue* queue = GetThis() == this ? (WorkQueue*)t_queue : nullptr;
+		if(queue) {
+			WorkQueue::MutexType::Lock lock(queue->mutex);
+			if(!queue->tasks.empty()) {
+				return true;
+			}
+		}
+		return m_taskCount > m_pinnedCount;
+	}
   	
 	bool Scheduler::stopping() {
-		MutexType::Lock lock(m_mutex);
 		return m_autoStop && m_stopping 
-			&& m_fibers.empty() && m_activeThreadCount == 0;
+			&& m_taskCount == 0 && m_activeThreadCount == 0;
 	}
 	
 	//ʱôη
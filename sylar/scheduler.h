@@ -4,8 +4,10 @@
 #include<memory>
 #include "fiber.h"
 #include "thread.h"
+#include "task.h"
 #include<vector>
 #include<list>
+#include<atomic>
 
 namespace sylar {
 	
@@ -13,95 +15,125 @@ namespace sylar {
 	public:
 		typedef std::shared_ptr<Scheduler> ptr;
 		typedef Mutex MutexType;
+		//ύ񼯺ϣռɺͨschedule(batch)һ
+		class Batch : Noncopyable {
+		friend class Scheduler;
+		public:
+			~Batch() { m_tasks.clear();}
+			template<class FiberOrCb>
+			void add(FiberOrCb fc, int thread = -1) {
+				Task* task = Task::Create();
+				task->assign(std::move(fc));
+				task->thread = thread;
+				if(task->empty()) {
+					Task::Destroy(task);
+					return;
+				}
+				m_tasks.push_back(task);
+			}
+			size_t size() const { return m_tasks.size();}
+			bool empty() const { return m_tasks.empty();}
+		private:
+			TaskList m_tasks;
+		};
+		
 		Scheduler(size_t threads = 1, bool use_caller = true, const std::string& name = "");
 		virtual ~Scheduler();
 		
 		const std::string& getName() const { return m_name;}
+		//صǷڹջЭִУҪstart()֮ǰ
+		//ջЭгֻʵʹõջݣʺϴӣлʱڴ濽
+		//ÿʹԼһ鹲ջЭ̰󶨵ջ߳ʹʱӣ߳
+		//֮ٻָĹջЭ
+		void setSharedStack(bool v) { m_sharedStack = v;}
+		bool isSharedStack() const { return m_sharedStack;}
 		
 		static Scheduler* GetThis();
 		static Fiber* GetMainFiber();
+		//ǰ߳еĹ߳±꣬ǹ̷߳-1
+		//use_callerĵ̶̹߳Ϊһ±
+		static int GetWorkerIndex();
 		
 		void start();
 		void stop();
 		//fiberص
+		//ǰ߳ΪĹ߳ʱ뱾̵߳ıضУ̵ֱָ߳ӷ̵߳ıضУ
+		//빲ע
+		//Task::INLINE_SIZEĻصֱӱڣ̻߳棬Ҫѷ
 		template<class FiberOrCb>
 		void schedule(FiberOrCb fc, int thread = -1) {
-			bool need_tickle = false;
-			{
-				MutexType::Lock lock(m_mutex);
-				need_tickle = scheduleNoLock(fc, thread);
+			Task* task = Task::Create();
+			task->assign(std::move(fc));
+			task->thread = thread;
+			if(task->empty()) {
+				Task::Destroy(task);
+				return;
 			}
-			if(need_tickle) {
-				tickle();
+			if(enqueue(task)) {
+				tickleThread(thread);
 			}
 		}
-		//
+		//ãȡԪеЭ̻ص
 		template<class InputIterator>
 		void schedule(InputIterator begin, InputIterator end) {
-			bool need_tickle = false;
-			{
-				MutexType::Lock lock(m_mutex);
-				while(begin != end) {
-					need_tickle = scheduleNoLock(&*begin, -1) || need_tickle;
-					++begin;
-				}
-			}
-			if(need_tickle) {
-				tickle();
+			Batch batch;
+			while(begin != end) {
+				batch.add(&*begin);
+				++begin;
 			}
+			schedule(batch);
 		}
+		//ãδ̵ָֻ߳һͬһУ໽min(, ߳)߳
+		//úbatchΪ
+		void schedule(Batch& batch);
 	protected:
 		virtual void tickle(); //
+		//ָ̣߳Ͷݸ̵߳threadΪ-1ֶ֧ʱͬtickle()
+		virtual void tickleThread(int thread);
+		//counṭ߳ٵһtickle()
+		void tickleIdle(size_t count);
 		void run();
 		virtual bool stopping();
 		virtual void idle();
 		
 		void setThis();
 		bool hasIdleThreads(){ return m_idleThreadCount > 0;}
+		//Ƿеǰִ߳̿е񣺱̱߳ضзǿգߴδ̵ָ߳
+		//̵ָ߳ڣ߳Ϊ˵һֱת
+		bool hasWork();
+		//߳use_callerĵ̣߳
+		size_t getWorkerCount() const { return m_queues.size();}
 	private:
-		//صfiberУʼΪգ򷵻true
-		template<class FiberOrCb>
-		bool scheduleNoLock(FiberOrCb fc, int thread) {
-			bool need_tickle = m_fibers.empty();
-			FiberAndThread ft(fc, thread);
-			if(ft.fiber || ft.cb) {
-				m_fibers.push_back(ft);
-			}
-			return need_tickle;
-		}
+		struct WorkQueue;
+		//ӦУĶԭΪգͶݸ̣߳򷵻true
+		bool enqueue(Task* task);
+		//ӱ̱߳ضȡһִ
+		bool popLocal(WorkQueue* queue, Task*& task);
+		//ӹעȡһִ߳̿е
+		//̵ָ߳ʱͨtickle_threadظ߳id
+		bool popInjected(Task*& task, int& tickle_thread);
+		//̵߳ıضȡһȡ
+		bool steal(size_t index, Task*& task, int& tickle_thread);
+		//߳idҶӦıضУ߳δrun()ʱnullptr
+		WorkQueue* getQueue(int thread);
 	private:
-		struct FiberAndThread {
-			Fiber::ptr fiber;
-			std::function<void()> cb;
-			int thread;
-			FiberAndThread(Fiber::ptr f, int thr)
-				:fiber(f), thread(thr) {}
-			FiberAndThread(Fiber::ptr* f, int thr)
-				:thread(thr) {
-				fiber.swap(*f);
-			}
-			
-			FiberAndThread(std::function<void()> f, int thr)
-      	:cb(f), thread(thr) {
-      }
-			FiberAndThread(std::function<void()>* f, int thr)
-      	:thread(thr) {
-      	cb.swap(*f);
-      }
-			FiberAndThread() 
-				:thread(-1){
-			}
-			//ÿ 
-			void reset() {
-				fiber = nullptr;
-				cb = nullptr;
-				thread = -1;
-			}		
-		};	
+		//ÿ߳˽еУ̴߳Ӷȡ̴߳Ӷβȡ
+		struct WorkQueue {
+			typedef Spinlock MutexType;
+			~WorkQueue() { tasks.clear();}
+			MutexType mutex;
+			TaskList tasks;
+			std::atomic<int> threadId = {-1};		//߳id߳̽run()
+		};
 	private:	
 		MutexType m_mutex;
 		std::vector<Thread::ptr> m_threads; //̳߳
-		std::list<FiberAndThread> m_fibers;	//ƻִЭ̶
+		TaskList m_fibers;	//עУǹ߳ύ
+		std::vector<WorkQueue*> m_queues;		//̱߳ضУ±Ϊ߳̽run()˳
+		std::atomic<size_t> m_queueIndex = {0};
+		std::atomic<size_t> m_injectedCount = {0}; //עе
+		std::atomic<size_t> m_taskCount = {0};		 //ждִе
+		std::atomic<size_t> m_pinnedCount = {0};	 //̵ָ߳
 		Fiber::ptr m_rootFiber;
 		std::string m_name;
 	protected:
@@ -111,6 +143,8 @@ namespace sylar {
 		std::atomic<size_t> m_idleThreadCount = {0};
 		bool m_stopping = true;
 		bool m_autoStop = false;
+		bool m_sharedStack = false;
+		SharedStackSet* m_sharedStacks = nullptr;	//Ĺջ
 		int m_rootThread = 0;
 	};
 }
@@ -0,0 +1,152 @@
+#include "task.h"
+#include "thread.h"
+
+namespace sylar {
+
+	//线程缓存的空闲任务上限，超过后一半归还到全局空闲链表
+	static const size_t s_cache_max = 256;
+	//线程缓存为空时一次从全局空闲链表取出的数量
+	static const size_t s_cache_batch = 64;
+	//全局空闲链表上限，突发大量任务之后不会一直占着内存
+	static const size_t s_global_max = 16384;
+
+	//全局空闲链表，用于在提交任务的线程和执行任务的线程之间平衡空闲任务
+	//生产者线程不断分配、消费者线程不断释放时，空闲任务通过这里流回生产者
+	struct TaskFreeList {
+		Spinlock mutex;
+		Task* head = nullptr;
+		size_t count = 0;
+	};
+
+	static TaskFreeList* GetGlobalFreeList() {
+		//不释放，线程退出时的缓存归还到这里
+		static TaskFreeList* s_free_list = new TaskFreeList;
+		return s_free_list;
+	}
+
+	//线程私有的空闲任务缓存，空闲任务通过next单向连接
+	class TaskCache {
+	public:
+		~TaskCache();
+
+		Task* pop() {
+			if(!m_head) {
+				refill();
+				if(!m_head) {
+					return nullptr;
+				}
+			}
+			Task* task = m_head;
+			m_head = task->next;
+			task->next = nullptr;
+			--m_count;
+			return task;
+		}
+
+		void push(Task* task) {
+			task->prev = nullptr;
+			task->next = m_head;
+			m_head = task;
+			if(++m_count > s_cache_max) {
+				flush(s_cache_max / 2);
+			}
+		}
+	private:
+		void refill() {
+			TaskFreeList* fl = GetGlobalFreeList();
+			Spinlock::Lock lock(fl->mutex);
+			while(fl->head && m_count < s_cache_batch) {
+				Task* task = fl->head;
+				fl->head = task->next;
+				--fl->count;
+				task->next = m_head;
+				m_head = task;
+				++m_count;
+			}
+		}
+
+		//归还n个空闲任务到全局空闲链表
+		void flush(size_t n) {
+			if(n == 0 || !m_head) {
+				return;
+			}
+			Task* first = m_head;
+			Task* last = first;
+			size_t i = 1;
+			while(i < n && last->next) {
+				last = last->next;
+				++i;
+			}
+			m_head = last->next;
+			m_count -= i;
+
+			TaskFreeList* fl = GetGlobalFreeList();
+			{
+				Spinlock::Lock lock(fl->mutex);
+				if(fl->count < s_global_max) {
+					last->next = fl->head;
+					fl->head = first;
+					fl->count += i;
+					return;
+				}
+			}
+			last->next = nullptr;
+			while(first) {
+				Task* task = first;
+				first = first->next;
+				delete task;
+			}
+		}
+	private:
+		Task* m_head = nullptr;
+		size_t m_count = 0;
+	};
+
+	static thread_local TaskCache t_task_cache;
+	//线程退出时缓存先于部分任务析构，之后的分配和释放直接走全局空闲链表
+	static thread_local bool t_task_cache_destroyed = false;
+
+	TaskCache::~TaskCache() {
+		t_task_cache_destroyed = true;
+		flush(m_count);
+	}
+
+	Task* Task::Create() {
+		Task* task = nullptr;
+		if(!t_task_cache_destroyed) {
+			task = t_task_cache.pop();
+		}
+		else {
+			TaskFreeList* fl = GetGlobalFreeList();
+			Spinlock::Lock lock(fl->mutex);
+			if(fl->head) {
+				task = fl->head;
+				fl->head = task->next;
+				--fl->count;
+				task->next = nullptr;
+			}
+		}
+		return task ? task : new Task;
+	}
+
+	void Task::Destroy(Task* task) {
+		task->clear();
+		if(!t_task_cache_destroyed) {
+			t_task_cache.push(task);
+			return;
+		}
+		TaskFreeList* fl = GetGlobalFreeList();
+		{
+			Spinlock::Lock lock(fl->mutex);
+			if(fl->count < s_global_max) {
+				task->prev = nullptr;
+				task->next = fl->head;
+				fl->head = task;
+				++fl->count;
+				return;
+			}
+		}
+		delete task;
+	}
+
+}
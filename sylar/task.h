@@ -0,0 +1,175 @@
+#ifndef __SYLAR_TASK_H__
+#define __SYLAR_TASK_H__
+
+#include<memory>
+#include<functional>
+#include<new>
+#include<type_traits>
+#include<utility>
+#include "fiber.h"
+#include "noncopyable.h"
+
+namespace sylar {
+
+	//调度器任务：待执行协程或回调函数，以及指定执行的线程
+	//回调函数不超过INLINE_SIZE字节时直接构造在任务内部，任务对象从线程私有的空闲链表分配，
+	//队列通过prev/next侵入式连接，schedule(fiber)和schedule(lambda)都不需要堆分配
+	class Task : Noncopyable {
+	public:
+		static const size_t INLINE_SIZE = 48;
+
+		//从空闲链表取出一个空任务
+		static Task* Create();
+		//清空任务并归还到空闲链表
+		static void Destroy(Task* task);
+
+		~Task() { clear();}
+
+		//以下非模板重载按值传参，与模板重载匹配程度相同时优先选择非模板版本
+		void assign(Fiber::ptr f) {
+			fiber.swap(f);
+		}
+		//取走*f，原对象置空
+		void assign(Fiber::ptr* f) {
+			fiber.swap(*f);
+		}
+		void assign(std::function<void()> f) {
+			if(f) {
+				setCallback(std::move(f));
+			}
+		}
+		//取走*f，原对象置空
+		void assign(std::function<void()>* f) {
+			if(*f) {
+				setCallback(std::move(*f));
+				*f = nullptr;
+			}
+		}
+		//函数指针、lambda、std::bind等可调用对象
+		template<class F>
+		void assign(F&& f) {
+			setCallback(std::forward<F>(f));
+		}
+
+		bool empty() const { return !fiber && !m_invoke;}
+		bool hasCallback() const { return m_invoke != nullptr;}
+		//执行回调函数
+		void invoke() { m_invoke(m_storage);}
+		//释放协程和回调函数，回到空任务状态
+		void clear() {
+			fiber = nullptr;
+			if(m_destroy) {
+				m_destroy(m_storage);
+			}
+			m_invoke = nullptr;
+			m_destroy = nullptr;
+			thread = -1;
+		}
+	public:
+		Fiber::ptr fiber;
+		int thread = -1;
+		Task* prev = nullptr;
+		Task* next = nullptr;
+	private:
+		Task() {}
+
+		template<class F>
+		void setCallback(F&& f) {
+			typedef typename std::decay<F>::type Fn;
+			setCallback(std::forward<F>(f), std::integral_constant<bool
+				, sizeof(Fn) <= INLINE_SIZE && std::alignment_of<Fn>::value <= sizeof(void*) * 2>());
+		}
+		//内联保存
+		template<class F>
+		void setCallback(F&& f, std::true_type) {
+			typedef typename std::decay<F>::type Fn;
+			new (m_storage) Fn(std::forward<F>(f));
+			m_invoke = [](void* p) { (*(Fn*)p)();};
+			m_destroy = [](void* p) { ((Fn*)p)->~Fn();};
+		}
+		//过大的可调用对象放到堆上，只保存指针
+		template<class F>
+		void setCallback(F&& f, std::false_type) {
+			typedef typename std::decay<F>::type Fn;
+			*(Fn**)m_storage = new Fn(std::forward<F>(f));
+			m_invoke = [](void* p) { (**(Fn**)p)();};
+			m_destroy = [](void* p) { delete *(Fn**)p;};
+		}
+	private:
+		void (*m_invoke)(void*) = nullptr;
+		void (*m_destroy)(void*) = nullptr;
+		alignas(sizeof(void*) * 2) char m_storage[INLINE_SIZE];
+	};
+
+	//Task的侵入式双向链表，不拥有任务对象
+	class TaskList {
+	public:
+		bool empty() const { return m_head == nullptr;}
+		size_t size() const { return m_size;}
+		Task* front() const { return m_head;}
+		Task* back() const { return m_tail;}
+
+		void push_back(Task* task) {
+			task->next = nullptr;
+			task->prev = m_tail;
+			if(m_tail) {
+				m_tail->next = task;
+			}
+			else {
+				m_head = task;
+			}
+			m_tail = task;
+			++m_size;
+		}
+
+		void erase(Task* task) {
+			if(task->prev) {
+				task->prev->next = task->next;
+			}
+			else {
+				m_head = task->next;
+			}
+			if(task->next) {
+				task->next->prev = task->prev;
+			}
+			else {
+				m_tail = task->prev;
+			}
+			task->prev = task->next = nullptr;
+			--m_size;
+		}
+
+		//把other中的任务全部移动到队尾
+		void splice(TaskList& other) {
+			if(other.empty()) {
+				return;
+			}
+			if(m_tail) {
+				m_tail->next = other.m_head;
+				other.m_head->prev = m_tail;
+			}
+			else {
+				m_head = other.m_head;
+			}
+			m_tail = other.m_tail;
+			m_size += other.m_size;
+			other.m_head = other.m_tail = nullptr;
+			other.m_size = 0;
+		}
+
+		//销毁所有剩余任务
+		void clear() {
+			while(m_head) {
+				Task* task = m_head;
+				erase(task);
+				Task::Destroy(task);
+			}
+		}
+	private:
+		Task* m_head = nullptr;
+		Task* m_tail = nullptr;
+		size_t m_size = 0;
+	};
+}
+
+#endif
@@ -1,6 +1,8 @@
 #include "thread.h"
 #include "log.h"
 #include "util.h"
+#include<errno.h>
+#include<time.h>
 
 namespace sylar{
 	
@@ -23,6 +25,26 @@ namespace sylar{
 			throw std::logic_error("sem_wait error");
 		}
 	}
+	bool Semaphore::waitFor(uint64_t ms) {
+		struct timespec ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += ms / 1000;
+		ts.tv_nsec += (ms % 1000) * 1000000;
+		if(ts.tv_nsec >= 1000000000) {
+			ts.tv_sec += 1;
+			ts.tv_nsec -= 1000000000;
+		}
+		while(sem_timedwait(&m_semaphore, &ts)) {
+			if(errno == EINTR) {
+				continue;
+			}
+			if(errno == ETIMEDOUT) {
+				return false;
+			}
+			throw std::logic_error("sem_timedwait error");
+		}
+		return true;
+	}
 	//ź10sem_wait()߳
 	void Semaphore::notify() {
 		if(sem_post(&m_semaphore)) {
@@ -20,6 +20,8 @@ namespace sylar {
 	  Semaphore(uint32_t count = 0);
 	  ~Semaphore();
 	  void wait();
+	  //ȴms룬ʱfalse
+	  bool waitFor(uint64_t ms);
 	  void notify();
 	private:
 		Semaphore(const Semaphore&) = delete;
@@ -140,6 +142,11 @@ namespace sylar {
 			pthread_mutex_lock(&m_mutex);
 		}
 		
+		//ѱռʱfalse
+		bool tryLock() {
+			return pthread_mutex_trylock(&m_mutex) == 0;
+		}
+		
 		void unlock() {
 			pthread_mutex_unlock(&m_mutex);
 		}
@@ -1,50 +1,32 @@
 #include "timer.h"
 #include "util.h"
+#include "log.h"
+#include "macro.h"
+#include<string.h>
 
 namespace sylar {
 
-	bool Timer::Comparator::operator()(const Timer::ptr& lhs
-		,const Timer::ptr& rhs) const {
-		if(!lhs && !rhs) {
-			return false;
-		}
-		
-		if(!lhs) {
-			return true;
-		}
-		
-		if(!rhs) {
-			return false;
-		}
-		if(lhs->m_next < rhs->m_next) {
-			return true;
-		}
-		if(lhs->m_next > rhs->m_next) {
-			return false;
-		}
-		return lhs.get() < rhs.get();
-	}
-	
 	Timer::Timer(uint64_t ms, std::function<void()> cb,
 		bool recurring, TimerManager* manager)
 		:m_recurring(recurring)
 		,m_ms(ms)
 		,m_cb(cb)
 		,m_manager(manager) {
-		m_next = sylar::GetCurrentMS() + m_ms;	
+		m_next = m_manager->getNow() + m_ms;	
 	}
 
-	Timer::Timer(uint64_t next)
-		:m_next(next) {	
-	}
-	
   //ȡʱ¼
 	bool Timer::cancel() {
+		if(m_shard >= 0) {
+			return m_manager->cancelShardTimer(this);
+		}
+		//ʱֳеڽͷ
+		Timer::ptr self;
 		TimerManager::RWMutexType::WriteLock lock(m_manager->m_mutex);
 		if(m_cb) {
 			m_cb = nullptr;
-			auto it = m_manager->m_timers.find(shared_from_this());
-			m_manager->m_timers.erase(it);
+			m_manager->m_wheel.remove(this);
+			self.swap(m_self);
 			return true;
 		}
 		return false;
@@ -52,22 +34,24 @@ namespace sylar {
 	
 	//öʱ¼m_ms¼󵽴¼
 	bool Timer::refresh() {
+		if(m_shard >= 0) {
+			return m_manager->resetShardTimer(this, TimerManager::TimerShard::REFRESH, 0, true);
+		}
 		TimerManager::RWMutexType::WriteLock lock(m_manager->m_mutex);
 		if(!m_cb) {
 			return false;
 		}
-		auto it = m_manager->m_timers.find(shared_from_this());
-		if(it == m_manager->m_timers.end()) {
-			return false;
-		}
-		m_manager->m_timers.erase(it);
-		m_next = sylar::GetCurrentMS() + m_ms;
-		m_manager->m_timers.insert(shared_from_this());
+		m_manager->m_wheel.remove(this);
+		m_next = m_manager->getNow() + m_ms;
+		m_manager->m_wheel.add(this);
 		return true;
 	}
 	
 	//
 	bool Timer::reset(uint64_t ms, bool from_now) {
+		if(m_shard >= 0) {
+			return m_manager->resetShardTimer(this, TimerManager::TimerShard::RESET, ms, from_now);
+		}
 		if(ms == m_ms && !from_now) {
 			return true;
 		}
@@ -75,14 +59,10 @@ namespace sylar {
 		if(!m_cb) {
 			return false;
 		}
-		auto it = m_manager->m_timers.find(shared_from_this());
-		if(it == m_manager->m_timers.end()) {
-			return false;
-		}
-		m_manager->m_timers.erase(it);
+		m_manager->m_wheel.remove(this);
 		uint64_t start = 0;
 		if(from_now) {
-			start = sylar::GetCurrentMS();
+			start = m_manager->getNow();
 		}
 		else {
 			start = m_next - m_ms;
@@ -93,19 +73,272 @@ namespace sylar {
 		return true;
 	}
 	
+	TimerWheel::TimerWheel(uint64_t now_ms)
+		:m_current(now_ms) {
+		memset(m_slots, 0, sizeof(m_slots));
+		memset(m_bits, 0, sizeof(m_bits));
+	}
+	
+	TimerWheel::~TimerWheel() {
+		std::vector<TimerNode*> timers;
+		clear(m_current, timers);
+		for(auto& node : timers) {
+			if(!node->m_func) {
+				static_cast<Timer*>(node)->m_self.reset();
+			}
+		}
+	}
+	
+	void TimerWheel::add(TimerNode* timer) {
+		place(timer);
+		++m_size;
+	}
+	
+	void TimerWheel::add(TimerNode* timer, uint64_t expire_ms) {
+		timer->m_next = expire_ms;
+		add(timer);
+	}
+	
+	void TimerWheel::remove(TimerNode* timer) {
+		if(timer->m_slot < 0) {
+			return;
+		}
+		unlink(timer);
+		--m_size;
+	}
+	
+	void TimerWheel::place(TimerNode* timer) {
+		uint64_t expire = timer->m_next < m_current ? m_current : timer->m_next;
+		uint64_t delta = expire - m_current;
+		if(delta < (uint64_t)ROOT_SIZE) {
+			link(expire & (ROOT_SIZE - 1), timer);
+			return;
+		}
+		for(int level = 1; level <= LEVELS; ++level) {
+			int shift = LevelShift(level) + LEVEL_BITS;
+			if(level == LEVELS && delta >> shift) {
+				//Χȷ߲ԶĲۣ·ʱʵʱ
+				expire = m_current + (1ull << shift) - 1;
+			}
+			if(level == LEVELS || delta < (1ull << shift)) {
+				link(LevelOffset(level) + ((expire >> LevelShift(level)) & (LEVEL_SIZE - 1)), timer);
+				return;
+			}
+		}
+	}
+	
+	void TimerWheel::link(int slot, TimerNode* timer) {
+		TimerNode*& head = m_slots[slot];
+		timer->m_prevNode = nullptr;
+		timer->m_nextNode = head;
+		if(head) {
+			head->m_prevNode = timer;
+		}
+		head = timer;
+		timer->m_slot = slot;
+		m_bits[slot >> 6] |= 1ull << (slot & 63);
+	}
+	
+	void TimerWheel::unlink(TimerNode* timer) {
+		int slot = timer->m_slot;
+		if(timer->m_prevNode) {
+			timer->m_prevNode->m_nextNode = timer->m_nextNode;
+		}
+		else {
+			m_slots[slot] = timer->m_nextNode;
+			if(!timer->m_nextNode) {
+				m_bits[slot >> 6] &= ~(1ull << (slot & 63));
+			}
+		}
+		if(timer->m_nextNode) {
+			timer->m_nextNode->m_prevNode = timer->m_prevNode;
+		}
+		timer->m_prevNode = timer->m_nextNode = nullptr;
+		timer->m_slot = -1;
+	}
+	
+	TimerNode* TimerWheel::take(int slot) {
+		TimerNode* list = m_slots[slot];
+		m_slots[slot] = nullptr;
+		m_bits[slot >> 6] &= ~(1ull << (slot & 63));
+		return list;
+	}
+	
+	void TimerWheel::cascade(int slot) {
+		TimerNode* list = take(slot);
+		while(list) {
+			TimerNode* timer = list;
+			list = list->m_nextNode;
+			place(timer);
+		}
+	}
+	
+	int TimerWheel::findSlot(int begin, int end) const {
+		for(int i = begin; i < end;) {
+			int word = i >> 6;
+			uint64_t bits = m_bits[word] >> (i & 63);
+			if(bits) {
+				int slot = i + __builtin_ctzll(bits);
+				return slot < end ? slot : -1;
+			}
+			i = (word + 1) << 6;
+		}
+		return -1;
+	}
+	
+	uint64_t TimerWheel::getNextExpire() const {
+		if(!m_size) {
+			return ~0ull;
+		}
+		int index = m_current & (ROOT_SIZE - 1);
+		uint64_t next = ~0ull;
+		int slot = findSlot(index, ROOT_SIZE);
+		if(slot >= 0) {
+			next = m_current + (slot - index);
+			//0㱾ʣĲκһ·䣬m_currentڱ߽ʱһηm_current
+			if(index) {
+				return next;
+			}
+		}
+		else {
+			slot = findSlot(0, index);
+			if(slot >= 0) {
+				next = m_current - index + ROOT_SIZE + slot;
+			}
+		}
+		for(int level = 1; level <= LEVELS; ++level) {
+			int shift = LevelShift(level);
+			int offset = LevelOffset(level);
+			uint64_t cur = m_current >> shift;
+			int index = cur & (LEVEL_SIZE - 1);
+			//m_currentڱ۵ı߽ʱǰ±Ĳۻûз䣨expire()ͣڱ߽ϣ´δʱŷ䣩
+			//m_currentڣǰ±ĲѾеĶʱҪתһȦ
+			int begin = (m_current & ((1ull << shift) - 1)) ? index + 1 : index;
+			int slot = findSlot(offset + begin, offset + LEVEL_SIZE);
+			if(slot < 0) {
+				slot = findSlot(offset, offset + begin);
+				if(slot < 0) {
+					continue;
+				}
+				slot += LEVEL_SIZE;
+			}
+			uint64_t time = (cur + (slot - offset - index)) << shift;
+			if(time < next) {
+				next = time;
+			}
+		}
+		return next;
+	}
+	
+	void TimerWheel::expire(uint64_t now_ms, std::vector<TimerNode*>& expired) {
+		while(m_current <= now_ms) {
+			if(!m_size) {
+				m_current = now_ms + 1;
+				break;
+			}
+			int index = m_current & (ROOT_SIZE - 1);
+			if(index == 0) {
+				//0תһȦѸ߲㵱ǰ۷
+				for(int level = 1; level <= LEVELS; ++level) {
+					int i = (m_current >> LevelShift(level)) & (LEVEL_SIZE - 1);
+					cascade(LevelOffset(level) + i);
+					if(i != 0) {
+						break;
+					}
+				}
+			}
+			TimerNode* list = take(index);
+			while(list) {
+				TimerNode* timer = list;
+				list = list->m_nextNode;
+				timer->m_prevNode = timer->m_nextNode = nullptr;
+				timer->m_slot = -1;
+				expired.push_back(timer);
+				--m_size;
+			}
+			//мĿղۣԶһ·
+			int slot = findSlot(index + 1, ROOT_SIZE);
+			uint64_t next = m_current - index + (slot >= 0 ? slot : ROOT_SIZE);
+			m_current = next > now_ms ? now_ms + 1 : next;
+		}
+	}
+	
+	void TimerWheel::clear(uint64_t now_ms, std::vector<TimerNode*>& timers) {
+		for(int slot = findSlot(0, SLOT_COUNT); slot >= 0; slot = findSlot(slot + 1, SLOT_COUNT)) {
+			TimerNode* list = take(slot);
+			while(list) {
+				TimerNode* timer = list;
+				list = list->m_nextNode;
+				timer->m_prevNode = timer->m_nextNode = nullptr;
+				timer->m_slot = -1;
+				timers.push_back(timer);
+			}
+		}
+		m_size = 0;
+		m_current = now_ms;
+	}
 
-	TimerManager::TimerManager() {
-		m_previouseTime = sylar::GetCurrentMS();
+	TimerManager::TimerManager()
+		:m_wheel(sylar::GetMonotonicMS()) {
+		m_now = sylar::GetMonotonicMS();
+	}
+	
+	uint64_t TimerManager::updateNow() {
+		uint64_t now_ms = sylar::GetMonotonicMS();
+		//߳ͬʱˢʱϴֵ
+		uint64_t old = m_now;
+		while(old < now_ms && !m_now.compare_exchange_weak(old, now_ms)) {
+		}
+		return now_ms;
+	}
+	
+	uint64_t TimerManager::getNow() {
+		//ڹ߳ʱûidle()ˢ»棬һεȴ
+		if(getTimerShard() < 0) {
+			return updateNow();
+		}
+		return m_now;
 	}
 	
 	TimerManager::~TimerManager() {
-	 	
+		for(auto i : m_shards) {
+			delete i;
+		}
+	}
+	
+	void TimerManager::initTimerShards(size_t count) {
+		SYLAR_ASSERT(m_shards.empty());
+		uint64_t now_ms = sylar::GetMonotonicMS();
+		for(size_t i = 0; i < count; ++i) {
+			m_shards.push_back(new TimerShard(i, now_ms));
+		}
 	}
 	
-	//m_timersвһtimerշָ 
+	TimerManager::TimerShard* TimerManager::getCurrentShard() {
+		if(m_shards.empty()) {
+			return nullptr;
+		}
+		int index = getTimerShard();
+		if(index < 0 || index >= (int)m_shards.size()) {
+			return nullptr;
+		}
+		return m_shards[index];
+	}
+	
+	//ʱвһtimerշָ 
 	Timer::ptr TimerManager::addTimer(uint64_t ms, std::function<void()> cb
 			,bool recurring) {
 		Timer::ptr timer(new Timer(ms, cb, recurring, this));
+		TimerShard* shard = getCurrentShard();
+		if(shard) {
+			//Ƭ߳Լʱ֣ҲҪѣ̻߳صidleʱ¼ȴʱ
+			timer->m_shard = shard->index;
+			timer->m_active = true;
+			timer->m_self = timer;
+			shard->wheel.add(timer.get());
+			shard->count.store(shard->wheel.size(), std::memory_order_relaxed);
+			return timer;
+		}
 		RWMutexType::WriteLock lock(m_mutex);
 		addTimer(timer, lock);
 		return timer;
@@ -125,63 +358,119 @@ namespace sylar {
 	}
 	
 	uint64_t TimerManager::getNextTimer() {
-		RWMutexType::ReadLock lock(m_mutex);
-		m_tickled = false;
-		if(m_timers.empty()) {
+		uint64_t now_ms = updateNow();
+		uint64_t next = ~0ull;
+		{
+			RWMutexType::WriteLock lock(m_mutex);
+			m_tickled = false;
+			m_nextExpire = m_wheel.getNextExpire();
+			next = m_nextExpire;
+		}
+		TimerShard* shard = getCurrentShard();
+		if(shard) {
+			std::vector<Timer::ptr> released;
+			processOps(shard, released);
+			uint64_t shard_next = shard->wheel.getNextExpire();
+			if(shard_next < next) {
+				next = shard_next;
+			}
+		}
+		if(next == ~0ull) {
 			return ~0ull;
 		}
 		
-		const Timer::ptr& next = *m_timers.begin();
-		uint64_t now_ms = sylar::GetCurrentMS();
-		if(now_ms >= next->m_next) {
+		if(now_ms >= next) {
 			return 0;
 		}
 		else {
-			return next->m_next - now_ms;
+			return next - now_ms;
 		}
 	}
 	
 	//Ķʱ
 	void TimerManager::listExpiredCb(std::vector<std::function<void()>>& cbs) {
-		uint64_t now_ms = sylar::GetCurrentMS();
-		std::vector<Timer::ptr> expired;
+		uint64_t now_ms = updateNow();
+		std::vector<TimerNode*> expired;
+		TimerShard* shard = getCurrentShard();
+		if(shard) {
+			std::vector<Timer::ptr> released;
+			processOps(shard, released);
+			shard->wheel.expire(now_ms, expired);
+			for(auto& node : expired) {
+				if(node->m_func) {
+					uint32_t seq = node->m_linkSeq;
+					cbs.push_back([node, seq](){
+						node->m_func(node, seq);
+					});
+					releaseShardNode(shard, node);
+					continue;
+				}
+				Timer* timer = static_cast<Timer*>(node);
+				if(timer->m_recurring && timer->m_active) {
+					cbs.push_back(timer->m_cb);
+					timer->m_next = now_ms + timer->m_ms;
+					shard->wheel.add(timer);
+					continue;
+				}
+				//̵߳cancelһ
+				bool active = true;
+				if(!timer->m_recurring && timer->m_active.compare_exchange_strong(active, false)) {
+					cbs.push_back(std::move(timer->m_cb));
+				}
+				timer->m_cb = nullptr;
+				released.push_back(std::move(timer->m_self));
+			}
+			shard->count.store(shard->wheel.size(), std::memory_order_relaxed);
+			expired.clear();
+		}
 		{
 			RWMutexType::ReadLock lock(m_mutex);
-			if(m_timers.empty()) {
+			if(m_wheel.empty()) {
 				return;
 			}
 		}
+		//ѭĶʱڽͷ
+		std::vector<Timer::ptr> released;
 		RWMutexType::WriteLock lock(m_mutex);
 		
-		bool rollover = detectClockRollover(now_ms);
-		if(!rollover && ((*m_timers.begin())->m_next > now_ms)) {
-			return;
-		}
-		Timer::ptr now_timer(new Timer(now_ms));
-		auto it = rollover ? m_timers.end() : m_timers.lower_bound(now_timer); //lower_bount(key)еһֵСkeyԪصĵ
-		while(it != m_timers.end() && (*it)->m_next == now_ms) {
-			++it;
-		}
-		expired.insert(expired.begin(), m_timers.begin(), it); //m_timersйڵԪزexpired
-		m_timers.erase(m_timers.begin(), it);
-		cbs.reserve(expired.size()); //Ԥռ
+		m_wheel.expire(now_ms, expired);
+		cbs.reserve(cbs.size() + expired.size()); //Ԥռ
 		
-		for(auto& timer : expired) {
-			cbs.push_back(timer->m_cb);
+		for(auto& node : expired) {
+			if(node->m_func) {
+				//ֵlambdastd::functionڲڴ
+				uint32_t seq = node->m_seq;
+				cbs.push_back([node, seq](){
+					node->m_func(node, seq);
+				});
+				continue;
+			}
+			Timer* timer = static_cast<Timer*>(node);
 			if(timer->m_recurring) {
+				cbs.push_back(timer->m_cb);
 				timer->m_next = now_ms + timer->m_ms;
-				m_timers.insert(timer);
+				m_wheel.add(timer);
 			}
 			else {
+				cbs.push_back(std::move(timer->m_cb));
 				timer->m_cb = nullptr;
+				released.push_back(std::move(timer->m_self));
 			}
 		}
 	}
 	
-	//ʱвһԪأΪףζʱһִлѲ
 	void TimerManager::addTimer(Timer::ptr val, RWMutexType::WriteLock& lock) {
-		auto it = m_timers.insert(val).first;
-		bool at_front = (it == m_timers.begin()) && !m_tickled;
+		val->m_self = val;
+		insertNode(val.get(), lock);
+	}
+	
+	//ʱвһԪأһμ絽ʱ䣬ִлѲ
+	void TimerManager::insertNode(TimerNode* node, RWMutexType::WriteLock& lock) {
+		m_wheel.add(node);
+		bool at_front = node->m_next < m_nextExpire && !m_tickled;
+		if(node->m_next < m_nextExpire) {
+			m_nextExpire = node->m_next;
+		}
 		if(at_front) {
 			m_tickled = true;
 		}
@@ -192,18 +481,218 @@ namespace sylar {
 		}
 	}
 	
-	bool TimerManager::detectClockRollover(uint64_t now_ms) {
-		bool rollover = false;
-		if(now_ms < m_previouseTime && now_ms < (m_previouseTime - 60 * 60 * 1000)) {
-			rollover = true;
+	uint32_t TimerManager::addTimerNode(TimerNode* node, uint64_t ms) {
+		SYLAR_ASSERT(node->m_func);
+		uint32_t seq = ++node->m_seq;
+		uint64_t next = getNow() + ms;
+		TimerShard* shard = getCurrentShard();
+		while(true) {
+			//ڵʱռãɱ߳ռûдĲʱֱӷ
+			uint64_t owner = 0;
+			if(shard && (node->m_owner.compare_exchange_strong(owner, shard->index + 1)
+						|| owner == (uint64_t)shard->index + 1)) {
+				node->m_addShard = shard->index;
+				linkShardNode(shard, node, seq, next);
+				return seq;
+			}
+			//ƬʱУдĲ˳򽻸ռõķƬ
+			if(postNodeOp(node, TimerShard::ADD_NODE, seq, next)) {
+				onTimerShardNotify(node->m_addShard);
+				return seq;
+			}
+			if(!shard) {
+				break;
+			}
+		}
+		RWMutexType::WriteLock lock(m_mutex);
+		SYLAR_ASSERT(node->m_slot < 0);
+		node->m_addShard = -1;
+		node->m_next = next;
+		insertNode(node, lock);
+		return seq;
+	}
+	
+	bool TimerManager::cancelTimerNode(TimerNode* node) {
+		if(node->m_addShard < 0) {
+			RWMutexType::WriteLock lock(m_mutex);
+			if(node->m_slot < 0) {
+				return false;
+			}
+			m_wheel.remove(node);
+			return true;
+		}
+		TimerShard* shard = getCurrentShard();
+		if(shard && node->m_owner.load() == (uint64_t)shard->index + 1) {
+			bool rt = node->m_slot >= 0;
+			shard->wheel.remove(node);
+			shard->count.store(shard->wheel.size(), std::memory_order_relaxed);
+			releaseShardNode(shard, node);
+			return rt;
+		}
+		//ڵ˵Ѿ
+		return postNodeOp(node, TimerShard::CANCEL_NODE, node->m_seq, 0);
+	}
+	
+	void TimerManager::linkShardNode(TimerShard* shard, TimerNode* node, uint32_t seq, uint64_t next) {
+		shard->wheel.remove(node);
+		node->m_linkSeq = seq;
+		shard->wheel.add(node, next);
+		shard->count.store(shard->wheel.size(), std::memory_order_relaxed);
+	}
+	
+	void TimerManager::releaseShardNode(TimerShard* shard, TimerNode* node) {
+		if(node->m_slot >= 0) {
+			return;
 		}
-		m_previouseTime = now_ms;
-		return rollover;
+		//߳ͶݵĲʱΪ0ʧܣȴٷ
+		uint64_t self = shard->index + 1;
+		node->m_owner.compare_exchange_strong(self, 0);
+	}
+	
+	bool TimerManager::postNodeOp(TimerNode* node, TimerShard::OpType type, uint32_t seq, uint64_t next) {
+		uint64_t owner = node->m_owner.load();
+		//ռͬһԭӱУռߴ֮ǰ
+		do {
+			if((owner & 0xffffffff) == 0) {
+				return false;
+			}
+		} while(!node->m_owner.compare_exchange_weak(owner, owner + (1ull << 32)));
+		TimerShard* shard = m_shards[(owner & 0xffffffff) - 1];
+		node->m_addShard = shard->index;
+		TimerShard::Op op;
+		op.type = type;
+		op.node = node;
+		op.seq = seq;
+		op.ms = next;
+		TimerShard::MutexType::Lock lock(shard->mutex);
+		shard->ops.push_back(std::move(op));
+		shard->hasOps = true;
+		return true;
 	}
 	
 	bool TimerManager::hasTimer() {
-		RWMutexType::ReadLock lock(m_mutex);
-		return !m_timers.empty();
+		{
+			RWMutexType::ReadLock lock(m_mutex);
+			if(!m_wheel.empty()) {
+				return true;
+			}
+		}
+		for(auto i : m_shards) {
+			if(i->count.load(std::memory_order_relaxed)) {
+				return true;
+			}
+		}
+		return false;
+	}
+	
+	bool TimerManager::hasPendingTimerOps() {
+		TimerShard* shard = getCurrentShard();
+		return shard && shard->hasOps;
+	}
+	
+	bool TimerManager::cancelShardTimer(Timer* timer) {
+		bool active = true;
+		if(!timer->m_active.compare_exchange_strong(active, false)) {
+			return false;
+		}
+		TimerShard* shard = m_shards[timer->m_shard];
+		if(getCurrentShard() != shard) {
+			//ѾռصִУʱɾƬ߳
+			postOp(timer, TimerShard::CANCEL);
+			return true;
+		}
+		Timer::ptr self;
+		self.swap(timer->m_self);
+		shard->wheel.remove(timer);
+		shard->count.store(shard->wheel.size(), std::memory_order_relaxed);
+		timer->m_cb = nullptr;
+		return true;
+	}
+	
+	bool TimerManager::resetShardTimer(Timer* timer, TimerShard::OpType type, uint64_t ms, bool from_now) {
+		if(!timer->m_active) {
+			return false;
+		}
+		TimerShard* shard = m_shards[timer->m_shard];
+		if(getCurrentShard() != shard) {
+			postOp(timer, type, ms, from_now);
+			//ֻresetǰʱ
+			if(type == TimerShard::RESET) {
+				onTimerShardNotify(shard->index);
+			}
+			return true;
+		}
+		std::vector<Timer::ptr> released;
+		applyOp(shard, timer, type, ms, from_now, getNow(), released);
+		return true;
+	}
+	
+	void TimerManager::postOp(Timer* timer, TimerShard::OpType type, uint64_t ms, bool from_now) {
+		TimerShard* shard = m_shards[timer->m_shard];
+		TimerShard::Op op;
+		op.type = type;
+		op.timer = timer->shared_from_this();
+		op.ms = ms;
+		op.from_now = from_now;
+		op.now = getNow();
+		TimerShard::MutexType::Lock lock(shard->mutex);
+		shard->ops.push_back(std::move(op));
+		shard->hasOps = true;
+	}
+	
+	void TimerManager::processOps(TimerShard* shard, std::vector<Timer::ptr>& released) {
+		if(!shard->hasOps) {
+			return;
+		}
+		std::vector<TimerShard::Op> ops;
+		{
+			TimerShard::MutexType::Lock lock(shard->mutex);
+			ops.swap(shard->ops);
+			shard->hasOps = false;
+		}
+		for(auto& op : ops) {
+			if(op.type == TimerShard::ADD_NODE) {
+				linkShardNode(shard, op.node, op.seq, op.ms);
+			}
+			else if(op.type == TimerShard::CANCEL_NODE) {
+				//߳̿Ѿ˽ڵ
+				if(op.node->m_linkSeq == op.seq) {
+					shard->wheel.remove(op.node);
+					shard->count.store(shard->wheel.size(), std::memory_order_relaxed);
+				}
+			}
+			else {
+				applyOp(shard, op.timer.get(), op.type, op.ms, op.from_now, op.now, released);
+				continue;
+			}
+			op.node->m_owner.fetch_sub(1ull << 32);
+			releaseShardNode(shard, op.node);
+		}
+	}
+	
+	void TimerManager::applyOp(TimerShard* shard, Timer* timer, TimerShard::OpType type, uint64_t ms
+			, bool from_now, uint64_t now, std::vector<Timer::ptr>& released) {
+		if(type == TimerShard::CANCEL) {
+			//Ѿڵڴʱͷ
+			shard->wheel.remove(timer);
+			timer->m_cb = nullptr;
+			if(timer->m_self) {
+				released.push_back(std::move(timer->m_self));
+			}
+		}
+		else if(timer->m_active && timer->m_slot >= 0) {
+			shard->wheel.remove(timer);
+			if(type == TimerShard::REFRESH) {
+				timer->m_next = now + timer->m_ms;
+			}
+			else if(ms != timer->m_ms || from_now) {
+				uint64_t start = from_now ? now : timer->m_next - timer->m_ms;
+				timer->m_ms = ms;
+				timer->m_next = start + ms;
+			}
+			shard->wheel.add(timer);
+		}
+		shard->count.store(shard->wheel.size(), std::memory_order_relaxed);
 	}
 	
 }
\ No newline at end of file
@@ -3,15 +3,50 @@
 
 #include<memory>
 #include<vector>
-#include<set>
+#include<functional>
+#include<atomic>
 #include "thread.h"
+#include "noncopyable.h"
 
 namespace sylar {
 
 class TimerManager;
+
+//ʱеʽڵ
+//TimerTimerManager䣻ֱʹTimerNodeʱڵǶԼĶӺȡڴ棬
+//ںڵִfunc(node, seq)seqΪӵšڵ㱻ȡ֮
+//ѾȡûִеĻصȻִУfuncӦȽseqgetSeq()ڵĻص
+//̷߳ƬʱڵռķƬ̹߳ڵʱķƬ߳ռ
+//̵߳ӺȡͶݸռõķƬڵ뿪ʱֲûдĲռ
+class TimerNode {
+friend class Timer;
+friend class TimerManager;
+friend class TimerWheel;
+public:
+	typedef void (*Callback)(TimerNode* node, uint32_t seq);
+	TimerNode(Callback func = nullptr)
+		:m_func(func) {
+	}
+	//һӵ
+	uint32_t getSeq() const { return m_seq;}
+private:
+	uint64_t m_next = 0;			//ȷִʱ
+	//ʱеλãͬһ۵Ľڵͨ˫
+	TimerNode* m_prevNode = nullptr;
+	TimerNode* m_nextNode = nullptr;
+	int m_slot = -1;
+	Callback m_func = nullptr;		//ΪձʾTimer
+	uint32_t m_seq = 0;
+	//ƬеĽڵ㣬ֻڴصĽڵ
+	int m_addShard = -1;					//һӽķƬ-1Ϊʱ֣Ӻȡĵά
+	uint32_t m_linkSeq = 0;				//ڷƬʱеӵţֻɷƬ̷߳
+	//32λΪռýڵķƬ±+10ʾУ32λΪͶݸ÷ƬûĲ
+	std::atomic<uint64_t> m_owner = {0};
+};
 	
-class Timer : public std::enable_shared_from_this<Timer> {
+class Timer : public TimerNode, public std::enable_shared_from_this<Timer> {
 friend class TimerManager;
+friend class TimerWheel;
 public:
 	typedef std::shared_ptr<Timer> ptr;
 	bool cancel();
@@ -20,20 +55,65 @@ public:
 private:
 	Timer(uint64_t ms, std::function<void()> cb,
 		bool recurring, TimerManager* manager);
-	Timer(uint64_t next);
 
 private:
 	bool m_recurring = false;	//Ƿѭʱ
 	uint64_t m_ms = 0;				//ִ
-	uint64_t m_next = 0;			//ȷִʱ
 	std::function<void()> m_cb;
 	TimerManager* m_manager = nullptr;
-private:
-	struct Comparator {
-		bool operator()(const Timer::ptr& lhs, const Timer::ptr& rhs) const;
-	};
+	Timer::ptr m_self;				//ʱʱ
+	int m_shard = -1;					//̷߳Ƭ-1ʾڹʱ
+	std::atomic<bool> m_active = {false};	//ƬʱǷûдȡ߳ȡʱͨռ
 };	
 
+//ֲʱ֣뾫ȣӺɾO(1)
+//0256ۣÿ1ms1~364ۣÿ۷ֱΪ2^82^142^20룬
+//߲Ĳ۵ʱеĶʱ·䵽Ͳ㣬2^26루Լ18.6СʱĶʱȷ߲㣬ʱ·
+//ʹ֤߱
+class TimerWheel : Noncopyable {
+public:
+	TimerWheel(uint64_t now_ms);
+	~TimerWheel();
+	//ڵĵʱӦĲۣѾڵķ뵱ǰ
+	void add(TimerNode* timer);
+	//ýڵĵʱ䣨룩
+	void add(TimerNode* timer, uint64_t expire_ms);
+	void remove(TimerNode* timer);
+	//Ҫʱ䣺0ĵʱ䣬߸߲һ·ʱ䣬ûжʱ~0ull
+	uint64_t getNextExpire() const;
+	//ƽnow_msȡеڵĶʱ
+	void expire(uint64_t now_ms, std::vector<TimerNode*>& expired);
+	//ȡжʱѵǰʱΪnow_ms
+	void clear(uint64_t now_ms, std::vector<TimerNode*>& timers);
+	bool empty() const { return m_size == 0;}
+	size_t size() const { return m_size;}
+private:
+	static const int ROOT_BITS = 8;
+	static const int ROOT_SIZE = 1 << ROOT_BITS;
+	static const int LEVEL_BITS = 6;
+	static const int LEVEL_SIZE = 1 << LEVEL_BITS;
+	static const int LEVELS = 3;		//0Ĳ
+	static const int SLOT_COUNT = ROOT_SIZE + LEVELS * LEVEL_SIZE;
+
+	static int LevelShift(int level) { return ROOT_BITS + (level - 1) * LEVEL_BITS;}
+	static int LevelOffset(int level) { return ROOT_SIZE + (level - 1) * LEVEL_SIZE;}
+
+	void place(TimerNode* timer);
+	void link(int slot, TimerNode* timer);
+	void unlink(TimerNode* timer);
+	//ȡ۵
+	TimerNode* take(int slot);
+	//Ѹ߲еĶʱ·
+	void cascade(int slot);
+	//[begin, end)еһǿղۣûз-1
+	int findSlot(int begin, int end) const;
+private:
+	uint64_t m_current;		//һҪĺ
+	size_t m_size = 0;
+	TimerNode* m_slots[SLOT_COUNT];
+	uint64_t m_bits[SLOT_COUNT / 64];		//ǿղ۵λͼ
+};
+
 class TimerManager {
 friend class Timer;
 public:
@@ -45,19 +125,94 @@ public:
 	Timer::ptr addConditionTimer(uint64_t ms, std::function<void()> cb
 		,std::weak_ptr<void> weak_cond
 		,bool recurring = false);
+	//ӲڴһԶʱڵ㣬ڵлصȡ֮ǰٴӣ
+	//ͬһڵӺȡɵ֤߱⡣ӵ
+	//Ƭ߳ʱ뱾̵߳ʱ֣ͬһ߳ȡʱ̼߳ڹʱ
+	uint32_t addTimerNode(TimerNode* node, uint64_t ms);
+	//ڵ㻹ûеʱȡtrueڵ̵߳ķƬʱͶȡͬtrue
+	bool cancelTimerNode(TimerNode* node);
+	//ʱʹõʱӣϵͳʱӰ
+	//ǰʱ䣨룩ʱӡˢºöΪ㡣getNextTimer()listExpiredCb()
+	//ÿεʱˢ»棬IOManageridle()ÿεȴǰһΡڹֱ߳ӷػ棬
+	//ʱ֮ܳӵĶʱӦǰҪʱȵupdateNow()̶߳ȡȷʱ
+	uint64_t getNow();
+	//ȡȷĵʱˢ»沢
+	uint64_t updateNow();
+	//÷Ƭʱֻǹʱֺ͵ǰ̵߳ķƬ
 	uint64_t getNextTimer();
 	void listExpiredCb(std::vector<std::function<void()>>& cbs);
 protected:
 	virtual void onTimerInsertedAtFront() = 0;
+	//count̷߳Ƭκ߳ʹöʱ֮ǰ
+	//Ƭ߳ϴĶʱ̵߳ʱ֣ɾĺ͵ڴ
+	//̶߳cancel/refresh/resetͶݵƬϢУɷƬ߳getNextTimer/listExpiredCbд
+	void initTimerShards(size_t count);
+	//ǰ̶߳ӦķƬ±꣬κηƬ-1
+	virtual int getTimerShard() { return -1;}
+	//̰߳shardƬеĶʱǰҪѷƬ߳¼ȴʱ
+	virtual void onTimerShardNotify(int shard) {}
 	void addTimer(Timer::ptr val, RWMutexType::WriteLock& lock);
+	//빲ʱ֣һμ絽ʱʱ
+	void insertNode(TimerNode* node, RWMutexType::WriteLock& lock);
+	//зƬ
 	bool hasTimer();
+	//ǰ̵߳ķƬǷ߳ͶݡδĲ
+	bool hasPendingTimerOps();
 private:
-	bool detectClockRollover(uint64_t now_ms);
+	//̷߳ƬʱֻɷƬ̷߳
+	struct TimerShard {
+		enum OpType {
+			CANCEL,
+			REFRESH,
+			RESET,
+			ADD_NODE,
+			CANCEL_NODE,
+		};
+		//߳ͶݵĲ
+		struct Op {
+			OpType type;
+			Timer::ptr timer;
+			uint64_t ms;
+			bool from_now;
+			uint64_t now;
+			TimerNode* node = nullptr;		//ڵseqΪӦţmsΪʱ
+			uint32_t seq = 0;
+		};
+		typedef Spinlock MutexType;
+		TimerShard(int idx, uint64_t now_ms)
+			:index(idx)
+			,wheel(now_ms) {
+		}
+		int index;
+		TimerWheel wheel;
+		std::atomic<size_t> count = {0};		//ʱ߳жǷΪ
+		MutexType mutex;
+		std::vector<Op> ops;
+		std::atomic<bool> hasOps = {false};
+	};
+	
+	//ǰ̵߳ķƬûзnullptr
+	TimerShard* getCurrentShard();
+	void postOp(Timer* timer, TimerShard::OpType type, uint64_t ms = 0, bool from_now = false);
+	//ִ߳ͶݵĲreleasedռʹõĶʱɵͷ
+	void processOps(TimerShard* shard, std::vector<Timer::ptr>& released);
+	void applyOp(TimerShard* shard, Timer* timer, TimerShard::OpType type, uint64_t ms, bool from_now
+			, uint64_t now, std::vector<Timer::ptr>& released);
+	//Ƭ̰߳ѽڵԼʱ֣Ѿʱɾ
+	void linkShardNode(TimerShard* shard, TimerNode* node, uint32_t seq, uint64_t next);
+	//ڵѾ뿪ʱֲûдĲʱռ
+	void releaseShardNode(TimerShard* shard, TimerNode* node);
+	//ڵƬռʱͶݲfalseʾڵ
+	bool postNodeOp(TimerNode* node, TimerShard::OpType type, uint32_t seq, uint64_t next);
+	bool cancelShardTimer(Timer* timer);
+	bool resetShardTimer(Timer* timer, TimerShard::OpType type, uint64_t ms, bool from_now);
 private:
 	RWMutexType m_mutex;
-	std::set<Timer::ptr, Timer::Comparator> m_timers;
+	TimerWheel m_wheel;
+	uint64_t m_nextExpire = ~0ull;		//ϴgetNextTimer()õ紦ʱ䣬¶ʱʱҪ
 	bool m_tickled = false;
-	uint64_t m_previouseTime = 0;
+	std::atomic<uint64_t> m_now = {0};
+	std::vector<TimerShard*> m_shards;
 };
 	
 }
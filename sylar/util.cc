@@ -6,9 +6,13 @@
 namespace sylar {
 	
 	static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
-	// ȡ߳Id
+	// ȡ߳Id߳id߳ڲ䣬ÿεöϵͳ
 	pid_t GetThreadId() {
-		return syscall(SYS_gettid);
+		static thread_local pid_t t_tid = 0;
+		if(!t_tid) {
+			t_tid = syscall(SYS_gettid);
+		}
+		return t_tid;
 	}
 	
 	//ȡЭId
@@ -53,4 +57,28 @@ namespace sylar {
 		gettimeofday(&tv, NULL);
 		return tv.tv_sec * 1000 * 1000ul + tv.tv_usec;
 	}
+	
+	uint64_t GetMonotonicMS() {
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return ts.tv_sec * 1000ul + ts.tv_nsec / 1000000;
+	}
+	
+	uint64_t GetMonotonicUS() {
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return ts.tv_sec * 1000 * 1000ul + ts.tv_nsec / 1000;
+	}
+	
+	uint64_t GetCoarseMonotonicMS() {
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+		return ts.tv_sec * 1000ul + ts.tv_nsec / 1000000;
+	}
+	
+	time_t GetCoarseTime() {
+		struct timespec ts;
+		clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+		return ts.tv_sec;
+	}
 }
\ No newline at end of file
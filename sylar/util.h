@@ -6,6 +6,7 @@
 #include<stdio.h>
 #include<unistd.h>
 #include<stdint.h>
+#include<time.h>
 #include<vector>
 #include<string>
 
@@ -20,6 +21,14 @@ namespace sylar {
 	//ʱ
 	uint64_t GetCurrentMS();
 	uint64_t GetCurrentUS();
+	//ʱӣϵͳʱӰ죬ڼʱͶʱ
+	uint64_t GetMonotonicMS();
+	uint64_t GetMonotonicUS();
+	//ȵʱӣֻȡһʱжʱ¼ʱ䣬Ⱦȷʱӿ죬
+	//ǻʵʱ루ʱӽĵںϿܳclock_getresľȣ㶨ʱĵʱ
+	uint64_t GetCoarseMonotonicMS();
+	//ȵϵͳʱ䣨룩־ʱ
+	time_t GetCoarseTime();
 }
 
 #endif
\ No newline at end of file
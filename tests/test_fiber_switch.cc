@@ -0,0 +1,59 @@
+#include "sylar/sylar.h"
+#include<ucontext.h>
+
+//协程切换微基准：对比当前编译的Fiber上下文后端与原始ucontext swapcontext的每秒切换次数
+//一次往返计为两次切换
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const uint64_t s_rounds = 1000000;
+
+static ucontext_t s_main_ctx;
+static ucontext_t s_ctx;
+
+static void ucontext_func() {
+	while(true) {
+		swapcontext(&s_ctx, &s_main_ctx);
+	}
+}
+
+void bench_ucontext() {
+	static char stack[128 * 1024];
+	getcontext(&s_ctx);
+	s_ctx.uc_link = nullptr;
+	s_ctx.uc_stack.ss_sp = stack;
+	s_ctx.uc_stack.ss_size = sizeof(stack);
+	makecontext(&s_ctx, &ucontext_func, 0);
+
+	uint64_t start = sylar::GetCurrentUS();
+	for(uint64_t i = 0; i < s_rounds; ++i) {
+		swapcontext(&s_main_ctx, &s_ctx);
+	}
+	uint64_t used = sylar::GetCurrentUS() - start;
+	SYLAR_LOG_INFO(g_logger) << "ucontext swapcontext: " << s_rounds * 2 << " switches in "
+		<< used << "us, " << (uint64_t)(s_rounds * 2 * 1000000.0 / used) << " switches/s";
+}
+
+void bench_fiber() {
+	sylar::Fiber::GetThis();
+	sylar::Fiber::ptr fiber(new sylar::Fiber([](){
+		while(true) {
+			sylar::Fiber::GetThis()->back();
+		}
+	}, 0, true));
+
+	uint64_t start = sylar::GetCurrentUS();
+	for(uint64_t i = 0; i < s_rounds; ++i) {
+		fiber->call();
+	}
+	uint64_t used = sylar::GetCurrentUS() - start;
+	SYLAR_LOG_INFO(g_logger) << "sylar::Fiber (" << sylar::FiberContextBackend() << "): "
+		<< s_rounds * 2 << " switches in " << used << "us, "
+		<< (uint64_t)(s_rounds * 2 * 1000000.0 / used) << " switches/s";
+}
+
+int main(int argc, char** argv) {
+	bench_ucontext();
+	bench_fiber();
+	return 0;
+}
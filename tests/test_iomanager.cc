@@ -5,6 +5,7 @@
 #include<unistd.h>
 #include<fcntl.h>
 #include<arpa/inet.h>
+#include<atomic>
 
 sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
 int sock = 0;
@@ -61,8 +62,34 @@ void test_timer() {
     }, true);
 }
 
+//worker idle in epoll_wait, another thread adds a timer that becomes the earliest one:
+//it must fire on time instead of after iomanager.max_timeout
+//a long busy poll keeps the worker between computing its timeout and going to sleep
+//while the timer is added
+void test_timer_wakeup() {
+    sylar::Config::Lookup<uint32_t>("iomanager.busy_poll_us", 0)->setValue(50000);
+    sylar::IOManager iom(1, false);
+    sylar::Semaphore sem;
+    for(int i = 0; i < 50; ++i) {
+        usleep(1000 + i % 5 * 200);
+        uint64_t ms = 10 + i % 3 * 10;
+        uint64_t start = sylar::GetMonotonicMS();
+        std::atomic<uint64_t> fired(0);
+        iom.addTimer(ms, [&fired, &sem](){
+            fired = sylar::GetMonotonicMS();
+            sem.notify();
+        });
+        SYLAR_ASSERT2(sem.waitFor(1000), "timer did not fire i=" + std::to_string(i));
+        uint64_t late = fired - start - ms;
+        SYLAR_ASSERT2(late < 100, "timer late " + std::to_string(late) + "ms i=" + std::to_string(i));
+    }
+    sylar::Config::Lookup<uint32_t>("iomanager.busy_poll_us", 0)->setValue(0);
+    SYLAR_LOG_INFO(g_logger) << "test_timer_wakeup ok";
+}
+
 int main(int argc, char** argv) {
 	//test1();
+	test_timer_wakeup();
 	test_timer();
 	return 0;
 }
\ No newline at end of file
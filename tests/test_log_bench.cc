@@ -0,0 +1,91 @@
+#include "sylar/sylar.h"
+#include<atomic>
+#include<iostream>
+#include<new>
+#include<stdlib.h>
+
+//日志吞吐基准：每条INFO日志的平均耗时和堆分配次数
+//用法：test_log_bench [每线程日志数] [线程数] [格式]
+
+static std::atomic<uint64_t> s_allocs{0};
+
+void* operator new(size_t size) {
+	++s_allocs;
+	void* p = malloc(size ? size : 1);
+	if(!p) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void operator delete(void* p) noexcept {
+	free(p);
+}
+
+//只格式化不输出，衡量日志事件和格式化本身的开销
+class NullLogAppender : public sylar::LogAppender {
+public:
+	void log(const sylar::Logger::ptr& logger, sylar::LogLevel::Level level, const sylar::LogEvent::ptr& event) override {
+		static thread_local sylar::LogStream t_stream;
+		t_stream.reset();
+		m_formatter->format(t_stream, logger, level, event);
+	}
+	std::string toYamlString() override { return "";}
+};
+
+static void run(const char* name, sylar::Logger::ptr logger, uint64_t n, int threads, int mode) {
+	std::vector<sylar::Thread::ptr> thrs;
+	//预热，让每个线程的事件缓存和缓冲区先分配好
+	for(int i = 0; i < 16; ++i) {
+		SYLAR_LOG_INFO(logger) << "warm up " << i;
+	}
+	uint64_t allocs = s_allocs;
+	uint64_t start = sylar::GetMonotonicUS();
+	for(int t = 0; t < threads; ++t) {
+		thrs.push_back(sylar::Thread::ptr(new sylar::Thread([logger, n, mode](){
+			for(uint64_t i = 0; i < n; ++i) {
+				if(mode == 0) {
+					SYLAR_LOG_DEBUG(logger) << "disabled message i=" << i;
+				}
+				else if(mode == 1) {
+					SYLAR_LOG_INFO(logger) << "request done i=" << i << " status=" << 200 << " path=/index.html";
+				}
+				else {
+					SYLAR_LOG_FMT_INFO(logger, "request done i=%lu status=%d path=%s", i, 200, "/index.html");
+				}
+			}
+		}, "bench_" + std::to_string(t))));
+	}
+	for(auto& i : thrs) {
+		i->join();
+	}
+	uint64_t used = sylar::GetMonotonicUS() - start;
+	uint64_t total = n * threads;
+	//线程创建本身也有少量分配，这里只关心是否随日志条数增长
+	std::cout << name << ": " << total << " msgs in " << used / 1000 << "ms, "
+		<< (used * 1000.0 / n) << " ns/msg per thread, "
+		<< ((s_allocs - allocs) * 1.0 / total) << " allocs/msg" << std::endl;
+}
+
+int main(int argc, char** argv) {
+	uint64_t n = argc > 1 ? atoll(argv[1]) : 1000000;
+	int threads = argc > 2 ? atoi(argv[2]) : 1;
+	std::string pattern = argc > 3 ? argv[3] : "%d{%Y-%m-%d %H:%M:%S}%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n";
+
+	sylar::Logger::ptr logger(new sylar::Logger("bench"));
+	logger->setLevel(sylar::LogLevel::INFO);
+	logger->setFormatter(pattern);
+	std::shared_ptr<NullLogAppender> null_appender(new NullLogAppender);
+	logger->addAppender(null_appender);
+	run("disabled", logger, n, threads, 0);
+	run("null stream", logger, n, threads, 1);
+	run("null fmt", logger, n, threads, 2);
+
+	logger->clearAppenders();
+	sylar::AsyncLogAppender::ptr async_appender(new sylar::AsyncLogAppender("/dev/null"));
+	logger->addAppender(async_appender);
+	run("async /dev/null", logger, n, threads, 1);
+	async_appender->stop();
+	std::cout << "async dropped=" << async_appender->getDroppedCount() << std::endl;
+	return 0;
+}
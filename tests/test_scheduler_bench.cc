@@ -0,0 +1,92 @@
+#include "sylar/sylar.h"
+#include<atomic>
+
+//调度器任务吞吐基准：外部线程提交回调、工作线程内提交回调、协程反复YieldToReady三种情况下的每秒任务数
+//用法：test_scheduler_bench [任务数] [线程数]
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static std::atomic<uint64_t> s_count{0};
+
+static void report(const char* name, uint64_t tasks, uint64_t used_us) {
+	SYLAR_LOG_INFO(g_logger) << name << ": " << tasks << " tasks in " << used_us / 1000 << "ms, "
+		<< (uint64_t)(tasks * 1000000.0 / used_us) << " tasks/s";
+}
+
+//非工作线程提交，任务进入共享注入队列
+void bench_inject(uint64_t n, int threads) {
+	s_count = 0;
+	uint64_t start = sylar::GetCurrentUS();
+	{
+		sylar::Scheduler sc(threads, false, "inject");
+		sc.start();
+		uint64_t a = 1, b = 2, c = 3;
+		for(uint64_t i = 0; i < n; ++i) {
+			//捕获4个8字节变量，超过std::function的内部存储
+			sc.schedule([a, b, c, i](){
+				s_count += (a + b + c + i) ? 1 : 0;
+			});
+		}
+		sc.stop();
+	}
+	SYLAR_ASSERT(s_count == n);
+	report("inject lambda", n, sylar::GetCurrentUS() - start);
+}
+
+//工作线程内提交，任务进入本线程本地队列
+void bench_local(uint64_t n, int threads) {
+	s_count = 0;
+	uint64_t start = sylar::GetCurrentUS();
+	{
+		sylar::Scheduler sc(threads, false, "local");
+		sc.start();
+		uint64_t per = n / threads;
+		for(int t = 0; t < threads; ++t) {
+			sc.schedule([per](){
+				uint64_t a = 1, b = 2, c = 3;
+				for(uint64_t i = 0; i < per; ++i) {
+					sylar::Scheduler::GetThis()->schedule([a, b, c, i](){
+						s_count += (a + b + c + i) ? 1 : 0;
+					});
+				}
+			});
+		}
+		sc.stop();
+		n = per * threads;
+	}
+	SYLAR_ASSERT(s_count == n);
+	report("local lambda", n, sylar::GetCurrentUS() - start);
+}
+
+//协程反复YieldToReady，每次都会把协程重新放回队列
+void bench_yield(uint64_t n, int threads) {
+	s_count = 0;
+	uint64_t fibers = 1000;
+	uint64_t per = n / fibers;
+	uint64_t start = sylar::GetCurrentUS();
+	{
+		sylar::Scheduler sc(threads, false, "yield");
+		sc.start();
+		for(uint64_t i = 0; i < fibers; ++i) {
+			sc.schedule([per](){
+				for(uint64_t j = 0; j < per; ++j) {
+					++s_count;
+					sylar::Fiber::YieldToReady();
+				}
+			});
+		}
+		sc.stop();
+	}
+	SYLAR_ASSERT(s_count == per * fibers);
+	report("fiber yield", per * fibers, sylar::GetCurrentUS() - start);
+}
+
+int main(int argc, char** argv) {
+	uint64_t n = argc > 1 ? atoll(argv[1]) : 1000000;
+	int threads = argc > 2 ? atoi(argv[2]) : 4;
+	SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::WARN);
+	bench_inject(n, threads);
+	bench_local(n, threads);
+	bench_yield(n, threads);
+	return 0;
+}
@@ -0,0 +1,243 @@
+#include "sylar/sylar.h"
+#include "sylar/timer.h"
+#include "sylar/macro.h"
+#include<set>
+#include<vector>
+#include<random>
+
+//TimerWheel的行为测试：用模拟的时钟驱动时间轮，触发顺序和时间与按到期时间排序的参考集合对比
+
+sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+struct TestNode : public sylar::TimerNode {
+	//时间轮析构时把没有回调的节点当作Timer处理，测试节点需要带回调
+	TestNode()
+		:sylar::TimerNode(&TestNode::OnTimer) {
+	}
+	static void OnTimer(sylar::TimerNode* node, uint32_t seq) {}
+	uint64_t expire = 0;
+	bool fired = false;
+};
+
+typedef std::set<std::pair<uint64_t, TestNode*>> RefSet;
+
+class WheelChecker {
+public:
+	WheelChecker(uint64_t now)
+		:m_now(now)
+		,m_wheel(now) {
+	}
+	~WheelChecker() {
+		std::vector<sylar::TimerNode*> timers;
+		m_wheel.clear(m_now, timers);
+	}
+
+	void add(TestNode* node, uint64_t delay) {
+		node->expire = m_now + delay;
+		node->fired = false;
+		m_wheel.add(node, node->expire);
+		m_ref.insert(std::make_pair(node->expire, node));
+		check();
+	}
+
+	void remove(TestNode* node) {
+		m_wheel.remove(node);
+		m_ref.erase(std::make_pair(node->expire, node));
+		check();
+	}
+
+	//推进到now，到期的定时器必须正好是参考集合中不晚于now的那些，并按到期时间排列
+	void advance(uint64_t now) {
+		SYLAR_ASSERT(now >= m_now);
+		m_now = now;
+		std::vector<sylar::TimerNode*> expired;
+		m_wheel.expire(now, expired);
+		uint64_t last = 0;
+		for(auto& i : expired) {
+			TestNode* node = static_cast<TestNode*>(i);
+			SYLAR_ASSERT2(node->expire <= now, "fired early expire=" + std::to_string(node->expire)
+					+ " now=" + std::to_string(now));
+			SYLAR_ASSERT2(node->expire >= last, "fired out of order");
+			SYLAR_ASSERT(!node->fired);
+			SYLAR_ASSERT(m_ref.erase(std::make_pair(node->expire, node)) == 1);
+			node->fired = true;
+			last = node->expire;
+		}
+		SYLAR_ASSERT2(m_ref.empty() || m_ref.begin()->first > now, "timer not fired expire="
+				+ std::to_string(m_ref.begin()->first) + " now=" + std::to_string(now));
+		check();
+	}
+
+	//每次推进到getNextExpire()，这时到期的定时器必须正好在到期时间触发
+	//返回推进的次数
+	size_t runExact(uint64_t until) {
+		size_t steps = 0;
+		while(!m_ref.empty()) {
+			uint64_t next = m_wheel.getNextExpire();
+			if(next > until) {
+				break;
+			}
+			SYLAR_ASSERT(next >= m_now);
+			size_t before = m_ref.size();
+			uint64_t first = m_ref.begin()->first;
+			advance(next);
+			//触发了定时器时，触发的时间就是最早的到期时间
+			SYLAR_ASSERT2(before == m_ref.size() || first == next, "fired late expire="
+					+ std::to_string(first) + " now=" + std::to_string(next));
+			++steps;
+		}
+		return steps;
+	}
+
+	uint64_t getNow() const { return m_now;}
+	size_t size() const { return m_ref.size();}
+	sylar::TimerWheel& getWheel() { return m_wheel;}
+private:
+	//最早处理时间不能晚于最早的到期时间，数量一致
+	void check() {
+		SYLAR_ASSERT(m_wheel.size() == m_ref.size());
+		SYLAR_ASSERT(m_wheel.empty() == m_ref.empty());
+		if(m_ref.empty()) {
+			SYLAR_ASSERT(m_wheel.getNextExpire() == ~0ull);
+		}
+		else {
+			SYLAR_ASSERT2(m_wheel.getNextExpire() <= m_ref.begin()->first, "next expire "
+					+ std::to_string(m_wheel.getNextExpire()) + " after earliest timer "
+					+ std::to_string(m_ref.begin()->first));
+		}
+	}
+private:
+	uint64_t m_now;
+	sylar::TimerWheel m_wheel;
+	RefSet m_ref;
+};
+
+//各层边界上的定时器逐层重新分配后按时触发，包括超出2^26毫秒范围的
+void test_cascade() {
+	static const uint64_t delays[] = {
+		0, 1, 255, 256, 257, 1000,
+		(1 << 14) - 1, 1 << 14, (1 << 14) + 1, 100000,
+		(1 << 20) - 1, 1 << 20, (1 << 20) + 1, 5000000,
+		(1 << 26) - 1, 1 << 26, (1 << 26) + 12345, (1ull << 30) + 7,
+	};
+	size_t count = sizeof(delays) / sizeof(delays[0]);
+	//起点不对齐任何一层的槽
+	WheelChecker checker(1234567);
+	std::vector<TestNode> nodes(count);
+	for(size_t i = 0; i < count; ++i) {
+		checker.add(&nodes[i], delays[i]);
+	}
+	size_t steps = checker.runExact(~0ull);
+	SYLAR_ASSERT(checker.size() == 0);
+	for(auto& i : nodes) {
+		SYLAR_ASSERT(i.fired);
+	}
+	SYLAR_LOG_INFO(g_logger) << "test_cascade ok steps=" << steps;
+}
+
+//从高层槽中删除，重新分配到低层之后再删除，已经删除的不能再触发
+void test_remove() {
+	WheelChecker checker(999);
+	std::vector<TestNode> nodes(8);
+	checker.add(&nodes[0], 300);					//第1层
+	checker.add(&nodes[1], 20000);				//第2层
+	checker.add(&nodes[2], 3000000);			//第3层
+	checker.add(&nodes[3], 1ull << 28);		//超出范围
+	checker.add(&nodes[4], 20001);
+	checker.add(&nodes[5], 3000001);
+	checker.add(&nodes[6], (1ull << 28) + 1);
+	checker.add(&nodes[7], 301);
+	checker.remove(&nodes[1]);
+	checker.remove(&nodes[2]);
+	checker.remove(&nodes[3]);
+	//nodes[4]所在的槽重新分配到低层以后再删除
+	checker.runExact(999 + 19000);
+	SYLAR_ASSERT(nodes[0].fired && nodes[7].fired);
+	checker.remove(&nodes[4]);
+	checker.runExact(999 + 2990000);
+	checker.remove(&nodes[5]);
+	checker.runExact(~0ull);
+	SYLAR_ASSERT(nodes[6].fired);
+	for(int i : {1, 2, 3, 4, 5}) {
+		SYLAR_ASSERT(!nodes[i].fired);
+	}
+	SYLAR_LOG_INFO(g_logger) << "test_remove ok";
+}
+
+//已经过期的定时器放入当前槽，下一次处理时触发
+void test_overdue() {
+	WheelChecker checker(5000);
+	TestNode a, b;
+	checker.add(&a, 100);
+	checker.advance(6000);
+	SYLAR_ASSERT(a.fired);
+	checker.getWheel().add(&b, 10);
+	SYLAR_ASSERT(checker.getWheel().getNextExpire() <= 6001);
+	std::vector<sylar::TimerNode*> expired;
+	checker.getWheel().expire(6001, expired);
+	SYLAR_ASSERT(expired.size() == 1 && expired[0] == &b);
+	SYLAR_LOG_INFO(g_logger) << "test_overdue ok";
+}
+
+//随机添加、删除和任意步长的推进，与参考集合逐步对比
+void test_random(uint64_t seed) {
+	std::mt19937_64 rng(seed);
+	WheelChecker checker(rng() % 1000000);
+	std::vector<TestNode> nodes(2000);
+	std::vector<TestNode*> free_nodes;
+	for(auto& i : nodes) {
+		free_nodes.push_back(&i);
+	}
+	std::vector<TestNode*> active;
+	for(int round = 0; round < 200000; ++round) {
+		int op = rng() % 10;
+		if(op < 5 && !free_nodes.empty()) {
+			TestNode* node = free_nodes.back();
+			free_nodes.pop_back();
+			//各层范围内的时长都要覆盖到
+			static const uint64_t ranges[] = {256, 1 << 14, 1 << 20, 1 << 26, 1ull << 28};
+			uint64_t delay = 1 + rng() % ranges[rng() % 5];
+			checker.add(node, delay);
+			active.push_back(node);
+		}
+		else if(op < 7 && !active.empty()) {
+			size_t idx = rng() % active.size();
+			TestNode* node = active[idx];
+			active[idx] = active.back();
+			active.pop_back();
+			if(!node->fired) {
+				checker.remove(node);
+			}
+			free_nodes.push_back(node);
+		}
+		else if(op < 9) {
+			static const uint64_t steps[] = {1, 100, 1 << 12, 1 << 18, 1 << 24};
+			checker.advance(checker.getNow() + rng() % steps[rng() % 5]);
+		}
+		else {
+			checker.runExact(checker.getNow() + rng() % (1 << 16));
+		}
+		//已经触发的节点回收
+		for(size_t i = 0; i < active.size();) {
+			if(active[i]->fired) {
+				free_nodes.push_back(active[i]);
+				active[i] = active.back();
+				active.pop_back();
+			}
+			else {
+				++i;
+			}
+		}
+	}
+	checker.runExact(~0ull);
+	SYLAR_ASSERT(checker.size() == 0);
+	SYLAR_LOG_INFO(g_logger) << "test_random ok seed=" << seed;
+}
+
+int main(int argc, char** argv) {
+	test_cascade();
+	test_remove();
+	test_overdue();
+	test_random(argc > 1 ? strtoull(argv[1], nullptr, 10) : 20241018);
+	return 0;
+}
@@ -0,0 +1,91 @@
+#include "sylar/binlog.h"
+#include<iostream>
+#include<stdio.h>
+#include<string.h>
+#include<errno.h>
+#include<unistd.h>
+
+//把BinaryLogAppender写出的二进制日志还原成文本
+//用法：sylar_logdecode [-p 模式串] [文件...]，没有文件或者文件为-时读取标准输入
+
+static const char* s_default_pattern = "%d{%Y-%m-%d %H:%M:%S}%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n";
+
+static bool decode_file(sylar::BinaryLogDecoder& decoder, const char* name, FILE* fp) {
+	std::string buf;
+	size_t size = 0;
+	buf.resize(1024 * 1024);
+	while(true) {
+		if(size == buf.size()) {
+			buf.resize(buf.size() * 2);
+		}
+		size_t n = fread(&buf[size], 1, buf.size() - size, fp);
+		size += n;
+		int64_t rt = decoder.decode(buf.data(), size, std::cout);
+		if(rt < 0) {
+			std::cerr << name << ": invalid data" << std::endl;
+			return false;
+		}
+		//未解码的不完整记录移到开头，等待后续数据
+		memmove(&buf[0], &buf[rt], size - rt);
+		size -= rt;
+		if(n == 0) {
+			break;
+		}
+	}
+	if(ferror(fp)) {
+		std::cerr << name << ": read error errno=" << errno << " errstr=" << strerror(errno) << std::endl;
+		return false;
+	}
+	if(size) {
+		std::cerr << name << ": truncated record at end, " << size << " bytes" << std::endl;
+	}
+	return true;
+}
+
+int main(int argc, char** argv) {
+	std::string pattern = s_default_pattern;
+	int opt = 0;
+	while((opt = getopt(argc, argv, "p:h")) != -1) {
+		switch(opt) {
+			case 'p':
+				pattern = optarg;
+				break;
+			default:
+				std::cerr << "usage: " << argv[0] << " [-p pattern] [file...]" << std::endl;
+				return opt == 'h' ? 0 : 1;
+		}
+	}
+	sylar::LogFormatter fmt(pattern);
+	if(fmt.isError()) {
+		std::cerr << "invalid pattern: " << pattern << std::endl;
+		return 1;
+	}
+
+	bool ok = true;
+	if(optind >= argc) {
+		sylar::BinaryLogDecoder decoder(pattern);
+		ok = decode_file(decoder, "stdin", stdin);
+	}
+	for(int i = optind; i < argc; ++i) {
+		//每个文件单独解码，文件开头有自己的会话头
+		sylar::BinaryLogDecoder decoder(pattern);
+		if(strcmp(argv[i], "-") == 0) {
+			ok = decode_file(decoder, "stdin", stdin) && ok;
+			continue;
+		}
+		FILE* fp = fopen(argv[i], "rb");
+		if(!fp) {
+			std::cerr << argv[i] << ": open errno=" << errno << " errstr=" << strerror(errno) << std::endl;
+			ok = false;
+			continue;
+		}
+		ok = decode_file(decoder, argv[i], fp) && ok;
+		if(decoder.getErrorCount()) {
+			std::cerr << argv[i] << ": " << decoder.getErrorCount() << " of " << decoder.getEventCount()
+				<< " events could not be fully decoded" << std::endl;
+		}
+		fclose(fp);
+	}
+	std::cout.flush();
+	return ok ? 0 : 1;
+}